@@ -0,0 +1,222 @@
+// Micro-benchmarks for the core paths: natural sort, the slot filter, slot
+// enumeration, the diff engine and every restore strategy, run against synthetic
+// folders. Console exe built from bench.cpp + core.cpp (no UI code).
+//
+//   bench [work dir]     default: %TEMP%\dz_bench, deleted afterwards
+#include "core.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+namespace {
+
+constexpr int kSortReps = 5;
+constexpr int kEnumReps = 5;
+
+double Median(std::vector<double> v) {
+    if (v.empty()) return 0;
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+}
+
+// Names the way real folders look: plain numbers, zero-padded numbers, separators
+// and the odd annotated slot, so NaturalLess sees every branch.
+std::vector<std::wstring> MakeNames(size_t count, std::mt19937& rng) {
+    std::vector<std::wstring> names;
+    names.reserve(count);
+    names.push_back(L"bf2savefile");
+    for (size_t i = 1; names.size() < count; ++i) {
+        wchar_t buf[64];
+        switch (rng() % 4) {
+        case 0:  swprintf(buf, 64, L"bf2savefile_%zu", i); break;
+        case 1:  swprintf(buf, 64, L"bf2savefile_%05zu", i); break;
+        case 2:  swprintf(buf, 64, L"bf2savefile-%zu.%zu", i / 10, i % 10); break;
+        default: swprintf(buf, 64, L"bf2savefile %zu Boss", i); break;
+        }
+        names.push_back(buf);
+    }
+    std::shuffle(names.begin(), names.end(), rng);
+    return names;
+}
+
+bool MakeEmptyFile(const fs::path& path) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    CloseHandle(h);
+    return true;
+}
+
+bool WriteBytes(const fs::path& path, const std::vector<char>& data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), (std::streamsize)data.size());
+    return (bool)out;
+}
+
+void BenchSort(const std::vector<std::wstring>& names) {
+    std::vector<double> plain, keyed;
+    for (int rep = 0; rep < kSortReps; ++rep) {
+        std::vector<std::wstring> v = names;
+        int64_t start = QpcNow();
+        std::sort(v.begin(), v.end(), NaturalLess);
+        plain.push_back(QpcToUs(QpcNow() - start));
+
+        start = QpcNow();
+        std::vector<SlotEntry> entries;
+        entries.reserve(names.size());
+        for (const auto& n : names) entries.emplace_back(n); // key build is part of the cost
+        std::sort(entries.begin(), entries.end());
+        keyed.push_back(QpcToUs(QpcNow() - start));
+    }
+    printf("sort       n=%-7zu NaturalLess %10.3f ms   keys %10.3f ms\n", names.size(),
+           Median(plain) / 1000.0, Median(keyed) / 1000.0);
+}
+
+// Filter box keystrokes against a built index: queries of up to three characters are
+// one posting-list lookup, longer ones intersect their trigrams' lists and confirm
+// the candidates. (The UI's linear scan while a rebuild is pending is not measured.)
+void BenchFilter(const std::vector<std::wstring>& names) {
+    std::vector<SlotEntry> entries;
+    entries.reserve(names.size());
+    for (const auto& n : names) entries.emplace_back(n);
+    std::sort(entries.begin(), entries.end());
+
+    SlotFilter filter;
+    int64_t start = QpcNow();
+    filter.Build(entries);
+    const double buildUs = QpcToUs(QpcNow() - start);
+    printf("filter     n=%-7zu build %10.3f ms\n", names.size(), buildUs / 1000.0);
+
+    std::vector<uint32_t> hits;
+    for (const wchar_t* q : { L"7", L"42", L"123", L"_4567", L"boss" }) {
+        std::vector<double> runs;
+        for (int rep = 0; rep < kSortReps; ++rep) {
+            start = QpcNow();
+            filter.Match(q, hits);
+            runs.push_back(QpcToUs(QpcNow() - start));
+        }
+        printf("filter     n=%-7zu %-8s hits %-7zu median %10.1f us\n", names.size(), ToUtf8(q).c_str(), hits.size(),
+               Median(runs));
+    }
+}
+
+void BenchEnumerate(const fs::path& root, const std::vector<std::wstring>& names) {
+    fs::path folder = root / (L"enum_" + std::to_wstring(names.size()));
+    std::error_code ec;
+    fs::create_directories(folder, ec);
+    for (const auto& n : names) MakeEmptyFile(folder / n);
+    for (size_t i = 0; i < names.size() / 20; ++i) MakeEmptyFile(folder / (L"other_" + std::to_wstring(i)));
+
+    std::vector<double> runs;
+    std::vector<SlotEntry> files;
+    for (int rep = 0; rep < kEnumReps; ++rep) {
+        int64_t start = QpcNow();
+        EnumerateSlotFiles(folder.native(), files, [] { return false; });
+        runs.push_back(QpcToUs(QpcNow() - start));
+    }
+    printf("enumerate  n=%-7zu found %zu   median %10.3f ms\n", names.size(), files.size(), Median(runs) / 1000.0);
+    fs::remove_all(folder, ec);
+}
+
+// The diff engine against the per-block memcmp the delta writer used to do, on two
+// buffers that differ in one byte per 64 KiB.
+void BenchDiff(size_t bytes, std::mt19937& rng) {
+    std::vector<char> a(bytes);
+    for (auto& c : a) c = (char)rng();
+    std::vector<char> b = a;
+    for (size_t off = 0; off < b.size(); off += 16 * kDeltaBlock) b[off] ^= 0x5a;
+
+    std::vector<double> engine, blocks;
+    std::vector<ByteRange> ranges;
+    size_t differing = 0;
+    for (int rep = 0; rep < kSortReps; ++rep) {
+        int64_t start = QpcNow();
+        DiffRanges(a.data(), a.size(), b.data(), b.size(), 0, ranges);
+        engine.push_back(QpcToUs(QpcNow() - start));
+
+        start = QpcNow();
+        differing = 0;
+        for (size_t off = 0; off < bytes; off += kDeltaBlock) {
+            differing += std::memcmp(a.data() + off, b.data() + off, std::min(kDeltaBlock, bytes - off)) != 0;
+        }
+        blocks.push_back(QpcToUs(QpcNow() - start));
+    }
+    printf("diff       %6zu KiB %-6s median %8.3f ms  (%zu ranges)   memcmp blocks %8.3f ms  (%zu blocks)\n",
+           bytes >> 10, DiffEngineName(), Median(engine) / 1000.0, ranges.size(), Median(blocks) / 1000.0, differing);
+}
+
+// Two slots that share most blocks, the way consecutive save states do, restored
+// alternately over one target so delta mode has real work to skip.
+void BenchRestore(const fs::path& root, size_t bytes, std::mt19937& rng) {
+    fs::path folder = root / L"restore";
+    std::error_code ec;
+    fs::create_directories(folder, ec);
+
+    std::vector<char> a(bytes);
+    for (auto& c : a) c = (char)rng();
+    std::vector<char> b = a;
+    for (size_t off = 0; off < b.size(); off += 16 * kDeltaBlock) b[off] ^= 0x5a; // ~6% of blocks differ
+    const fs::path slots[2] = { folder / L"bf2savefile_1", folder / L"bf2savefile_2" };
+    const fs::path dest = folder / L"bf2savefile";
+    if (!WriteBytes(slots[0], a) || !WriteBytes(slots[1], b) || !WriteBytes(dest, a)) {
+        printf("restore    could not create test files in %s\n", ToUtf8(folder.wstring()).c_str());
+        return;
+    }
+
+    const int reps = bytes >= (8u << 20) ? 20 : 100;
+    const RestoreMode modes[] = { RestoreMode::Copy, RestoreMode::CopyEx, RestoreMode::Delta, RestoreMode::Atomic };
+    for (size_t cacheMb : { (size_t)0, (size_t)256 }) {
+        g_cache.SetBudget(cacheMb << 20);
+        for (RestoreMode mode : modes) {
+            LatencyStats stats;
+            int failed = 0;
+            for (int rep = 0; rep < reps; ++rep) {
+                RestoreTiming timing;
+                int64_t start = QpcNow();
+                RestoreSlot(slots[rep & 1], dest, mode, ec, &timing);
+                timing.ticks[kSeriesTotal] = QpcNow() - start;
+                if (ec) ++failed;
+                else stats.Record(timing);
+            }
+            auto total = stats.Summarize(kSeriesTotal);
+            printf("restore    %6zu KiB %-6s cache=%-3s median %8.3f ms  p99 %8.3f ms  "
+                   "(read %.3f  write %.3f  rename %.3f)%s\n",
+                   bytes >> 10, RestoreModeName(mode), cacheMb ? "on" : "off",
+                   total.median / 1000.0, total.p99 / 1000.0,
+                   stats.Summarize(kSeriesRead).median / 1000.0,
+                   stats.Summarize(kSeriesWrite).median / 1000.0,
+                   stats.Summarize(kSeriesRename).median / 1000.0,
+                   failed ? " FAILED" : "");
+        }
+    }
+    g_cache.SetBudget(0);
+    fs::remove_all(folder, ec);
+}
+
+} // namespace
+
+int wmain(int argc, wchar_t** argv) {
+    fs::path root = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / L"dz_bench";
+    std::error_code ec;
+    fs::create_directories(root, ec);
+    if (ec) {
+        printf("cannot create %s: %s\n", ToUtf8(root.wstring()).c_str(), ec.message().c_str());
+        return 1;
+    }
+
+    std::mt19937 rng(1234); // fixed seed: runs are comparable
+    for (size_t count : { (size_t)1000, (size_t)10000, (size_t)100000 }) {
+        auto names = MakeNames(count, rng);
+        BenchSort(names);
+        BenchFilter(names);
+        BenchEnumerate(root, names);
+    }
+    for (size_t bytes : { (size_t)64 << 10, (size_t)1 << 20, (size_t)16 << 20 }) {
+        BenchDiff(bytes, rng);
+        BenchRestore(root, bytes, rng);
+    }
+
+    if (argc <= 1) fs::remove_all(root, ec);
+    return 0;
+}
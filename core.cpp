@@ -0,0 +1,1989 @@
+#include "core.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <fstream>
+
+#include <compressapi.h>  // Cabinet.lib
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define DZ_X86 1
+#include <intrin.h>     // _BitScanForward
+#include <immintrin.h>  // SSE2/AVX2, dispatched at run time (no /arch needed)
+#else
+#define DZ_X86 0
+#endif
+
+// ---------- utf8 helpers ----------
+std::string ToUtf8(const std::wstring& s) {
+    if (s.empty()) return {};
+    int len = WideCharToMultiByte(CP_UTF8, 0, s.c_str(), -1, nullptr, 0, nullptr, nullptr);
+    std::string out(len ? len - 1 : 0, '\0');
+    if (len > 1) WideCharToMultiByte(CP_UTF8, 0, s.c_str(), -1, out.data(), len, nullptr, nullptr);
+    return out;
+}
+std::wstring FromUtf8(const std::string& s) {
+    if (s.empty()) return {};
+    int len = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, nullptr, 0);
+    std::wstring out(len ? len - 1 : 0, L'\0');
+    if (len > 1) MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, out.data(), len);
+    return out;
+}
+// ---------- natural compare (number-aware) ----------
+static bool IsSep(wchar_t c) {
+    return c == L' ' || c == L'_' || c == L'-' || c == L'.';
+}
+bool NaturalLess(const std::wstring& a, const std::wstring& b) {
+    size_t i = 0, j = 0, na = a.size(), nb = b.size();
+    while (i < na && j < nb) {
+        while (i < na && IsSep(a[i])) ++i;
+        while (j < nb && IsSep(b[j])) ++j;
+        if (i >= na || j >= nb) break;
+
+        bool ad = iswdigit(a[i]) != 0;
+        bool bd = iswdigit(b[j]) != 0;
+
+        if (ad && bd) {
+            unsigned long long va = 0, vb = 0;
+            size_t ia = i, jb = j;
+            while (ia < na && iswdigit(a[ia])) { va = va*10 + (unsigned)(a[ia]-L'0'); ++ia; }
+            while (jb < nb && iswdigit(b[jb])) { vb = vb*10 + (unsigned)(b[jb]-L'0'); ++jb; }
+            if (va != vb) return va < vb;
+            size_t lena = ia - i, lenb = jb - j;
+            if (lena != lenb) return lena < lenb;
+            i = ia; j = jb;
+            continue;
+        }
+
+        wchar_t ca = towlower(a[i]);
+        wchar_t cb = towlower(b[j]);
+        if (ca != cb) return ca < cb;
+        ++i; ++j;
+    }
+    return (na - i) < (nb - j);
+}
+
+// ---------- precomputed natural sort keys ----------
+NaturalKey MakeNaturalKey(const std::wstring& s) {
+    NaturalKey key;
+    key.units.reserve(s.size());
+    size_t i = 0, n = s.size();
+    while (i < n) {
+        if (IsSep(s[i])) {
+            while (i < n && IsSep(s[i])) ++i;
+            if (i == n) key.units.push_back(kKeyTrailingSep);
+        } else if (iswdigit(s[i])) {
+            unsigned long long v = 0;
+            size_t start = i;
+            while (i < n && iswdigit(s[i])) { v = v*10 + (unsigned)(s[i]-L'0'); ++i; }
+            key.units.push_back(kKeyNumber);
+            key.units.push_back((uint32_t)(v >> 32));
+            key.units.push_back((uint32_t)v);
+            key.units.push_back((uint32_t)(i - start));
+        } else {
+            key.units.push_back((uint32_t)towlower(s[i]));
+            ++i;
+        }
+    }
+    return key;
+}
+
+// ---------- enumerate slots (default "bf2savefile*") in natural order ----------
+// Iterative glob: on a mismatch after a '*', retry with the star eating one more
+// character. Linear for the usual single-star patterns.
+static bool GlobMatch(const std::wstring& name, const std::wstring& pattern) {
+    size_t n = 0, p = 0, star = std::wstring::npos, resume = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && pattern[p] == L'*') {
+            star = p++;
+            resume = n;
+        } else if (p < pattern.size() && (pattern[p] == L'?' || towlower(pattern[p]) == towlower(name[n]))) {
+            ++p;
+            ++n;
+        } else if (star != std::wstring::npos) {
+            p = star + 1;
+            n = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == L'*') ++p;
+    return p == pattern.size();
+}
+
+bool IsSlotName(const std::wstring& name, const std::wstring& pattern) {
+    if (name.rfind(L"~dz_", 0) == 0) return false; // a "*" pattern would otherwise list our temps
+    return GlobMatch(name, pattern);
+}
+
+bool EnumerateSlotFiles(const std::wstring& folder, std::vector<SlotEntry>& files,
+                        const std::function<bool()>& cancelled, const std::wstring& pattern) {
+    files.clear();
+    std::error_code ec;
+    if (IsPackPath(folder)) { // the archive index is the listing
+        auto pack = OpenPack(folder, ec);
+        if (pack) {
+            for (const auto& e : pack->Entries()) {
+                if (IsSlotName(e.name, pattern)) files.emplace_back(e.name);
+            }
+            std::sort(files.begin(), files.end());
+        }
+        return !cancelled();
+    }
+    if (!fs::exists(folder, ec) || !fs::is_directory(folder, ec)) return !cancelled();
+
+    for (auto const& entry : fs::directory_iterator(folder, fs::directory_options::skip_permission_denied, ec)) {
+        if (ec) break;
+        if (cancelled()) return false;
+        if (entry.is_regular_file(ec) || entry.is_directory(ec)) { // a directory is a slot group
+            std::wstring name = entry.path().filename().wstring();
+            if (!IsSlotName(name, pattern)) continue;
+            files.emplace_back(std::move(name));
+        }
+    }
+    if (cancelled()) return false;
+
+    std::sort(files.begin(), files.end());
+    assert(std::is_sorted(files.begin(), files.end(), [](const SlotEntry& a, const SlotEntry& b) {
+        return NaturalLess(a.name, b.name);
+    }));
+    return true;
+}
+
+// ---------- slot filter (trigram index) ----------
+static std::wstring FoldCase(const std::wstring& s) {
+    std::wstring out = s;
+    for (auto& ch : out) ch = towlower(ch);
+    return out;
+}
+// Up to three UTF-16 units at s[i], tagged with the length so "ab" and "\0ab" differ.
+static uint64_t Gram(const std::wstring& s, size_t i, size_t len) {
+    uint64_t key = (uint64_t)len << 48;
+    for (size_t k = 0; k < len; ++k) key |= (uint64_t)(uint16_t)s[i + k] << (16 * (2 - k));
+    return key;
+}
+
+void SlotFilter::Build(const std::vector<SlotEntry>& files) {
+    folded_.clear();
+    postings_.clear();
+    folded_.reserve(files.size());
+    for (uint32_t n = 0; n < (uint32_t)files.size(); ++n) {
+        folded_.push_back(FoldCase(files[n].name));
+        const std::wstring& s = folded_.back();
+        for (size_t len = 1; len <= 3; ++len) {
+            for (size_t i = 0; i + len <= s.size(); ++i) {
+                auto& list = postings_[Gram(s, i, len)];
+                if (list.empty() || list.back() != n) list.push_back(n); // once per name
+            }
+        }
+    }
+}
+
+void SlotFilter::Scan(const std::vector<SlotEntry>& files, const std::wstring& query, std::vector<uint32_t>& out) {
+    out.clear();
+    const std::wstring q = FoldCase(query);
+    for (uint32_t n = 0; n < (uint32_t)files.size(); ++n) {
+        if (FoldCase(files[n].name).find(q) != std::wstring::npos) out.push_back(n);
+    }
+}
+
+void SlotFilter::Match(const std::wstring& query, std::vector<uint32_t>& out) const {
+    out.clear();
+    const std::wstring q = FoldCase(query);
+    if (q.empty()) return;
+    const size_t gram = std::min<size_t>(q.size(), 3);
+    std::vector<const std::vector<uint32_t>*> lists;
+    for (size_t i = 0; i + gram <= q.size(); ++i) {
+        auto it = postings_.find(Gram(q, i, gram));
+        if (it == postings_.end()) return; // a gram no name has
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) {
+        return a->size() != b->size() ? a->size() < b->size() : std::less<>()(a, b);
+    });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+    // Each candidate is looked up in the longer lists by binary search from where the
+    // previous one was found: cost follows the rarest trigram, not the listing size.
+    out = *lists[0];
+    for (size_t k = 1; k < lists.size() && !out.empty(); ++k) {
+        auto from = lists[k]->begin();
+        size_t kept = 0;
+        for (uint32_t n : out) {
+            from = std::lower_bound(from, lists[k]->end(), n);
+            if (from == lists[k]->end()) break;
+            if (*from == n) out[kept++] = n;
+        }
+        out.resize(kept);
+    }
+    if (q.size() > 3) { // the trigrams can all be there without being adjacent
+        out.erase(std::remove_if(out.begin(), out.end(),
+                                 [&](uint32_t n) { return folded_[n].find(q) == std::wstring::npos; }),
+                  out.end());
+    }
+}
+
+// ---------- latency instrumentation (QueryPerformanceCounter) ----------
+int64_t QpcNow() {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+}
+double QpcToUs(int64_t ticks) {
+    static const double perUs = [] {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        return (double)f.QuadPart / 1e6;
+    }();
+    return (double)ticks / perUs;
+}
+
+// ---------- file metadata ----------
+std::error_code LastError() {
+    return std::error_code((int)GetLastError(), std::system_category());
+}
+uint64_t ToTicks(const FILETIME& ft) {
+    return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+FILETIME FromTicks(uint64_t ticks) {
+    return FILETIME{ (DWORD)ticks, (DWORD)(ticks >> 32) };
+}
+
+bool StatFile(const std::wstring& path, FileStamp& out, std::error_code& ec) {
+    WIN32_FILE_ATTRIBUTE_DATA fad{};
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fad) ||
+        (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        ec = std::make_error_code(std::errc::no_such_file_or_directory);
+        return false;
+    }
+    out.size = ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    out.lastWrite = ToTicks(fad.ftLastWriteTime);
+    return true;
+}
+
+// ---------- content hash (XXH64) ----------
+namespace {
+constexpr uint64_t kP1 = 11400714785074694791ull;
+constexpr uint64_t kP2 = 14029467366897019727ull;
+constexpr uint64_t kP3 = 1609587929392839161ull;
+constexpr uint64_t kP4 = 9650029242287828579ull;
+constexpr uint64_t kP5 = 2870177450012600261ull;
+
+inline uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+inline uint64_t Read64(const unsigned char* p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+inline uint32_t Read32(const unsigned char* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+inline uint64_t Round(uint64_t acc, uint64_t input) { return Rotl(acc + input * kP2, 31) * kP1; }
+inline uint64_t Merge(uint64_t acc, uint64_t v) { return (acc ^ Round(0, v)) * kP1 + kP4; }
+} // namespace
+
+Xxh64::Xxh64(uint64_t seed) : v_{ seed + kP1 + kP2, seed + kP2, seed, seed - kP1 } {}
+
+void Xxh64::Update(const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    total_ += len;
+    if (buffered_) {
+        size_t take = std::min(len, sizeof(buf_) - buffered_);
+        std::memcpy(buf_ + buffered_, p, take);
+        buffered_ += take; p += take; len -= take;
+        if (buffered_ < sizeof(buf_)) return;
+        for (int i = 0; i < 4; ++i) v_[i] = Round(v_[i], Read64(buf_ + 8 * i));
+        buffered_ = 0;
+    }
+    // Four independent lanes: the compiler keeps them in registers and the CPU
+    // overlaps the multiplies.
+    uint64_t v1 = v_[0], v2 = v_[1], v3 = v_[2], v4 = v_[3];
+    for (; len >= 32; p += 32, len -= 32) {
+        v1 = Round(v1, Read64(p));
+        v2 = Round(v2, Read64(p + 8));
+        v3 = Round(v3, Read64(p + 16));
+        v4 = Round(v4, Read64(p + 24));
+    }
+    v_[0] = v1; v_[1] = v2; v_[2] = v3; v_[3] = v4;
+    std::memcpy(buf_, p, len);
+    buffered_ = len;
+}
+
+uint64_t Xxh64::Digest() const {
+    uint64_t h;
+    if (total_ >= 32) {
+        h = Rotl(v_[0], 1) + Rotl(v_[1], 7) + Rotl(v_[2], 12) + Rotl(v_[3], 18);
+        for (int i = 0; i < 4; ++i) h = Merge(h, v_[i]);
+    } else {
+        h = v_[2] + kP5; // v_[2] is still the seed
+    }
+    h += total_;
+
+    const unsigned char* p = buf_;
+    size_t len = buffered_;
+    for (; len >= 8; p += 8, len -= 8) h = Rotl(h ^ Round(0, Read64(p)), 27) * kP1 + kP4;
+    if (len >= 4) { h = Rotl(h ^ (Read32(p) * kP1), 23) * kP2 + kP3; p += 4; len -= 4; }
+    for (; len; ++p, --len) h = Rotl(h ^ (*p * kP5), 11) * kP1;
+
+    h ^= h >> 33; h *= kP2;
+    h ^= h >> 29; h *= kP3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t Hash64(const void* data, size_t len) {
+    Xxh64 x;
+    x.Update(data, len);
+    return x.Digest();
+}
+
+bool HashFile(const std::wstring& path, uint64_t& hash, FileStamp& stamp, std::error_code& ec) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+
+    BY_HANDLE_FILE_INFORMATION info{};
+    if (!GetFileInformationByHandle(h, &info)) { ec = LastError(); CloseHandle(h); return false; }
+    stamp.size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    stamp.lastWrite = ToTicks(info.ftLastWriteTime);
+
+    Xxh64 x;
+    thread_local std::vector<char> chunk(1u << 20); // verify hashes the target after every restore
+    for (;;) {
+        DWORD got = 0;
+        if (!ReadFile(h, chunk.data(), (DWORD)chunk.size(), &got, nullptr)) { ec = LastError(); break; }
+        if (got == 0) break;
+        x.Update(chunk.data(), got);
+    }
+    CloseHandle(h);
+    if (ec) return false;
+    hash = x.Digest();
+    return true;
+}
+
+HashCache g_hashes;
+
+// ---------- RAM save cache ----------
+SaveCache g_cache;
+
+// ---------- content index ----------
+// Text file, UTF-8: a "dzindex 1" line, "folder=<path>", then one
+// "<size> <lastWrite> <hash hex> <name>" line per slot.
+void SlotIndex::Open(const std::wstring& folder, const fs::path& file) {
+    folder_ = folder;
+    file_ = file;
+    entries_.clear();
+    dirty_ = false;
+
+    std::ifstream in(file, std::ios::binary);
+    std::string line;
+    if (!std::getline(in, line) || line != "dzindex 1") return;
+    if (!std::getline(in, line) || line.rfind("folder=", 0) != 0 || FromUtf8(line.substr(7)) != folder) return;
+    while (std::getline(in, line)) {
+        unsigned long long size = 0, lastWrite = 0, hash = 0;
+        int used = 0;
+        if (sscanf(line.c_str(), "%llu %llu %llx %n", &size, &lastWrite, &hash, &used) < 3 || !used) continue;
+        IndexEntry& e = entries_[FromUtf8(line.substr((size_t)used))];
+        e.stamp = FileStamp{ size, lastWrite };
+        e.hash = hash;
+    }
+}
+
+bool SlotIndex::SaveIfDirty(std::error_code& ec) {
+    if (!dirty_ || file_.empty()) return true;
+    std::error_code dirEc;
+    fs::create_directories(file_.parent_path(), dirEc);
+
+    fs::path temp = file_;
+    temp += L".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out << "dzindex 1\n" << "folder=" << ToUtf8(folder_) << "\n";
+        char buf[64];
+        for (const auto& [name, e] : entries_) {
+            snprintf(buf, sizeof(buf), "%llu %llu %016llx ", (unsigned long long)e.stamp.size,
+                     (unsigned long long)e.stamp.lastWrite, (unsigned long long)e.hash);
+            out << buf << ToUtf8(name) << "\n";
+        }
+        if (!out) { ec = std::make_error_code(std::errc::io_error); return false; }
+    }
+    if (!SwapIntoPlace(temp, file_, ec)) return false;
+    dirty_ = false;
+    return true;
+}
+
+bool SlotIndex::Update(const std::wstring& name, IndexEntry& out) {
+    const std::wstring path = (fs::path(folder_) / name).native();
+    FileStamp stamp;
+    std::error_code ec;
+    if (!StatFile(path, stamp, ec)) {
+        dirty_ |= entries_.erase(name) != 0;
+        return false;
+    }
+    auto it = entries_.find(name);
+    if (it == entries_.end() || !(it->second.stamp == stamp)) {
+        uint64_t hash = 0;
+        if (!g_hashes.Find(path, stamp, hash) && !HashFile(path, hash, stamp, ec)) return false;
+        it = entries_.insert_or_assign(name, IndexEntry{ stamp, hash }).first;
+        dirty_ = true;
+    }
+    g_hashes.Insert(path, it->second.stamp, it->second.hash); // verification reuses it
+    out = it->second;
+    return true;
+}
+
+void SlotIndex::Retain(const std::vector<std::wstring>& names) {
+    std::unordered_map<std::wstring, IndexEntry> kept;
+    kept.reserve(names.size());
+    for (const auto& n : names) {
+        auto it = entries_.find(n);
+        if (it != entries_.end()) kept.emplace(n, it->second);
+    }
+    dirty_ |= kept.size() != entries_.size();
+    entries_.swap(kept);
+}
+
+// Case-folded so "D:\Saves" and "d:\saves" share one index.
+fs::path IndexPathFor(const fs::path& dir, const std::wstring& folder, const wchar_t* ext) {
+    std::wstring folded = folder;
+    for (auto& ch : folded) ch = towlower(ch);
+    wchar_t name[32];
+    swprintf(name, 32, L"%016llx", (unsigned long long)Hash64(folded.data(), folded.size() * sizeof(wchar_t)));
+    return dir / (name + std::wstring(ext));
+}
+
+// ---------- folder snapshot ----------
+// Binary, native endian: "DZSNAP1\0", folder (u32 length + UTF-16), dir last-write u64,
+// entry count u32, then per entry the name (u16 length + UTF-16) and key (u16 count +
+// u32 units). Bump the magic whenever the key encoding changes.
+namespace {
+constexpr char kSnapMagic[8] = { 'D', 'Z', 'S', 'N', 'A', 'P', '1', 0 };
+
+template <class T> void Put(std::vector<char>& out, T v) {
+    const char* p = (const char*)&v;
+    out.insert(out.end(), p, p + sizeof(T));
+}
+void PutWide(std::vector<char>& out, const std::wstring& s) {
+    const char* p = (const char*)s.data();
+    out.insert(out.end(), p, p + s.size() * sizeof(wchar_t));
+}
+
+// Bounds-checked reader over the loaded file.
+struct Reader {
+    const char* p;
+    const char* end;
+    template <class T> bool Get(T& v) {
+        if ((size_t)(end - p) < sizeof(T)) return false;
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+    template <class T> bool GetArray(T* out, size_t n) {
+        if ((size_t)(end - p) / sizeof(T) < n) return false;
+        std::memcpy(out, p, n * sizeof(T));
+        p += n * sizeof(T);
+        return true;
+    }
+    // Whether n items of T could still follow; checked before sizing anything from a
+    // length read out of the file.
+    bool Fits(size_t n, size_t each) const { return (size_t)(end - p) / each >= n; }
+};
+} // namespace
+
+bool DirWriteTime(const std::wstring& folder, uint64_t& ticks) {
+    WIN32_FILE_ATTRIBUTE_DATA fad{};
+    if (folder.empty() || !GetFileAttributesExW(folder.c_str(), GetFileExInfoStandard, &fad) ||
+        !(fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return false;
+    }
+    ticks = ToTicks(fad.ftLastWriteTime);
+    return true;
+}
+
+bool SaveFolderSnapshot(const fs::path& file, const std::wstring& folder, uint64_t dirWrite,
+                        const std::vector<SlotEntry>& files, std::error_code& ec) {
+    std::vector<char> out(kSnapMagic, kSnapMagic + sizeof(kSnapMagic));
+    Put<uint32_t>(out, (uint32_t)folder.size());
+    PutWide(out, folder);
+    Put<uint64_t>(out, dirWrite);
+    Put<uint32_t>(out, (uint32_t)files.size());
+    for (const auto& f : files) {
+        Put<uint16_t>(out, (uint16_t)f.name.size());
+        PutWide(out, f.name);
+        Put<uint16_t>(out, (uint16_t)f.key.units.size());
+        const char* units = (const char*)f.key.units.data();
+        out.insert(out.end(), units, units + f.key.units.size() * sizeof(uint32_t));
+    }
+
+    std::error_code dirEc;
+    fs::create_directories(file.parent_path(), dirEc);
+    fs::path temp = file;
+    temp += L".tmp";
+    FileStamp stamp; // lastWrite 0: SetFileTime leaves the time alone
+    if (!WriteWholeFile(temp.native(), out, stamp, ec)) {
+        DeleteFileW(temp.c_str());
+        return false;
+    }
+    return SwapIntoPlace(temp, file, ec);
+}
+
+bool LoadFolderSnapshot(const fs::path& file, const std::wstring& folder, uint64_t& dirWrite,
+                        std::vector<SlotEntry>& files) {
+    std::vector<char> data;
+    FileStamp stamp;
+    std::error_code ec;
+    if (!ReadWholeFile(file.native(), data, stamp, ec)) return false;
+
+    Reader r{ data.data(), data.data() + data.size() };
+    char magic[sizeof(kSnapMagic)];
+    uint32_t folderLen = 0, count = 0;
+    if (!r.GetArray(magic, sizeof(magic)) || std::memcmp(magic, kSnapMagic, sizeof(magic)) != 0) return false;
+    if (!r.Get(folderLen) || !r.Fits(folderLen, sizeof(wchar_t))) return false;
+    std::wstring saved(folderLen, L'\0');
+    if (!r.GetArray(saved.data(), folderLen) || saved != folder) return false;
+    if (!r.Get(dirWrite) || !r.Get(count)) return false;
+    if (!r.Fits(count, 2 * sizeof(uint16_t))) return false; // garbage count: no snapshot
+
+    std::vector<SlotEntry> loaded;
+    loaded.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint16_t nameLen = 0, unitCount = 0;
+        if (!r.Get(nameLen)) return false;
+        std::wstring name(nameLen, L'\0');
+        if (!r.GetArray(name.data(), nameLen) || !r.Get(unitCount)) return false;
+        NaturalKey key;
+        key.units.resize(unitCount);
+        if (!r.GetArray(key.units.data(), unitCount)) return false;
+        loaded.emplace_back(std::move(name), std::move(key));
+    }
+    if (r.p != r.end) return false;
+    files = std::move(loaded);
+    return true;
+}
+
+// ---------- config store ----------
+bool ConfigStore::Load(const fs::path& file, std::error_code& ec) {
+    file_ = file;
+    sections_.assign(1, Section{});
+    stamp_ = FileStamp{};
+    dirty_ = false;
+
+    std::vector<char> data;
+    if (!ReadWholeFile(file.native(), data, stamp_, ec)) {
+        if (ec == std::errc::no_such_file_or_directory) ec.clear();
+        return false;
+    }
+    std::string_view rest(data.data(), data.size());
+    while (!rest.empty()) {
+        size_t nl = rest.find('\n');
+        std::string_view line = rest.substr(0, nl);
+        rest = nl == std::string_view::npos ? std::string_view() : rest.substr(nl + 1);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1); // hand-edited in Notepad
+
+        if (line.size() >= 2 && line.front() == '[' && line.back() == ']') {
+            sections_.push_back(Section{ std::string(line.substr(1, line.size() - 2)), {} });
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == std::string_view::npos || eq == 0) sections_.back().entries.push_back(Entry{ {}, std::string(line) });
+        else sections_.back().entries.push_back(Entry{ std::string(line.substr(0, eq)), std::string(line.substr(eq + 1)) });
+    }
+    return true;
+}
+
+const std::string* ConfigStore::Find(std::string_view section, std::string_view key) const {
+    for (const auto& s : sections_) {
+        if (s.name != section) continue;
+        for (const auto& e : s.entries) {
+            if (!e.key.empty() && e.key == key) return &e.value;
+        }
+    }
+    return nullptr;
+}
+
+void ConfigStore::Set(std::string_view section, std::string_view key, std::string_view value) {
+    auto s = std::find_if(sections_.begin(), sections_.end(), [&](const Section& x) { return x.name == section; });
+    if (s == sections_.end()) {
+        sections_.push_back(Section{ std::string(section), {} });
+        s = sections_.end() - 1;
+    }
+    for (auto& e : s->entries) {
+        if (e.key.empty() || e.key != key) continue;
+        if (e.value == value) return;
+        e.value = value;
+        dirty_ = true;
+        return;
+    }
+    // Before any trailing blank lines, so a section keeps its separator.
+    auto at = s->entries.end();
+    while (at != s->entries.begin() && (at - 1)->key.empty() && (at - 1)->value.empty()) --at;
+    s->entries.insert(at, Entry{ std::string(key), std::string(value) });
+    dirty_ = true;
+}
+
+bool ConfigStore::Save(std::error_code& ec) {
+    ec.clear();
+    if (!dirty_) return true;
+    std::string text;
+    for (const auto& s : sections_) {
+        if (!s.name.empty()) {
+            const bool separated = text.size() >= 2 && text.compare(text.size() - 2, 2, "\n\n") == 0;
+            if (!text.empty() && !separated) text += '\n';
+            text += '[' + s.name + "]\n";
+        }
+        for (const auto& e : s.entries) {
+            if (!e.key.empty()) text += e.key + '=';
+            text += e.value;
+            text += '\n';
+        }
+    }
+
+    fs::path temp = TempPathFor(file_, L"tmp");
+    FileStamp keep; // lastWrite 0: SetFileTime leaves the time alone
+    if (!WriteWholeFile(temp.native(), text.data(), text.size(), keep, ec)) {
+        DeleteFileW(temp.c_str());
+        return false;
+    }
+    if (!SwapIntoPlace(temp, file_, ec)) return false;
+    StatFile(file_.native(), stamp_, ec); // what ChangedOnDisk compares against
+    ec.clear();
+    dirty_ = false;
+    return true;
+}
+
+bool ConfigStore::ChangedOnDisk() const {
+    FileStamp now;
+    std::error_code ec;
+    if (!StatFile(file_.native(), now, ec)) return stamp_.size != 0 || stamp_.lastWrite != 0; // deleted
+    return !(now == stamp_);
+}
+
+// ---------- I/O options ----------
+namespace {
+std::mutex g_ioMutex;
+IoOptions g_ioOptions;
+} // namespace
+
+const char* IoPriorityName(IoPriority p) {
+    switch (p) {
+    case IoPriority::Low:     return "low";
+    case IoPriority::VeryLow: return "verylow";
+    default:                  return "normal";
+    }
+}
+IoPriority ParseIoPriority(const std::string& s) {
+    if (s == "low")     return IoPriority::Low;
+    if (s == "verylow") return IoPriority::VeryLow;
+    return IoPriority::Normal;
+}
+const char* FlushModeName(FlushMode m) {
+    switch (m) {
+    case FlushMode::Flush:        return "flush";
+    case FlushMode::WriteThrough: return "writethrough";
+    default:                      return "lazy";
+    }
+}
+FlushMode ParseFlushMode(const std::string& s) {
+    if (s == "flush")        return FlushMode::Flush;
+    if (s == "writethrough") return FlushMode::WriteThrough;
+    return FlushMode::Lazy;
+}
+
+void SetIoOptions(const IoOptions& io) {
+    std::lock_guard<std::mutex> lock(g_ioMutex);
+    g_ioOptions = io;
+}
+IoOptions CurrentIoOptions() {
+    std::lock_guard<std::mutex> lock(g_ioMutex);
+    return g_ioOptions;
+}
+
+// A hint only: the I/O scheduler queues these behind normal-priority I/O (the
+// recorder, the emulator), trading restore latency for less jitter elsewhere.
+void ApplyIoPriority(HANDLE h, IoPriority p) {
+    if (p == IoPriority::Normal) return;
+    FILE_IO_PRIORITY_HINT_INFO hint{};
+    hint.PriorityHint = p == IoPriority::Low ? IoPriorityHintLow : IoPriorityHintVeryLow;
+    SetFileInformationByHandle(h, FileIoPriorityHintInfo, &hint, sizeof(hint));
+}
+
+bool FinishWrites(HANDLE h, const IoOptions& io, PhaseClock* clock, std::error_code& ec) {
+    if (clock) clock->Mark(kSeriesWrite);
+    if (io.flush == FlushMode::Flush && !FlushFileBuffers(h)) ec = LastError();
+    if (clock) clock->Mark(kSeriesFlush);
+    return !ec;
+}
+
+// ---------- whole-file I/O ----------
+// Reads the whole file; stamp is taken from the open handle so it matches the bytes.
+bool ReadWholeFile(const std::wstring& path, std::vector<char>& out, FileStamp& stamp, std::error_code& ec,
+                   const IoOptions& io) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, io.SourceFlags(), nullptr);
+    if (h == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+    ApplyIoPriority(h, io.priority);
+
+    BY_HANDLE_FILE_INFORMATION info{};
+    if (!GetFileInformationByHandle(h, &info)) { ec = LastError(); CloseHandle(h); return false; }
+    stamp.size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    stamp.lastWrite = ToTicks(info.ftLastWriteTime);
+
+    out.resize((size_t)stamp.size);
+    size_t done = 0;
+    while (done < out.size()) {
+        DWORD chunk = (DWORD)std::min<size_t>(out.size() - done, 1u << 30), got = 0;
+        if (!ReadFile(h, out.data() + done, chunk, &got, nullptr)) { ec = LastError(); break; }
+        if (got == 0) { ec = std::make_error_code(std::errc::io_error); break; } // shrank under us
+        done += got;
+    }
+    CloseHandle(h);
+    return !ec;
+}
+
+// Rewrites dest in place (like copy_file's overwrite) and stamps it with the source's
+// last-write time so it looks exactly like a copied file.
+bool WriteWholeFile(const std::wstring& path, const char* data, size_t size, const FileStamp& stamp,
+                    std::error_code& ec, const IoOptions& io, PhaseClock* clock) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL | io.TargetFlags(), nullptr);
+    if (h == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+    ApplyIoPriority(h, io.priority);
+
+    size_t done = 0;
+    while (done < size) {
+        DWORD chunk = (DWORD)std::min<size_t>(size - done, 1u << 30), put = 0;
+        if (!WriteFile(h, data + done, chunk, &put, nullptr)) { ec = LastError(); break; }
+        done += put;
+    }
+    if (!ec && !SetEndOfFile(h)) ec = LastError();
+    if (!ec) {
+        FILETIME ft = FromTicks(stamp.lastWrite);
+        SetFileTime(h, nullptr, nullptr, &ft);
+        FinishWrites(h, io, clock, ec);
+    }
+    CloseHandle(h);
+    return !ec;
+}
+
+// ---------- delta restore ----------
+// Maps the current target read-only and finds where the new contents differ with
+// DiffRanges (the AVX2, SSE2 or word-loop engine picked at startup). Each differing
+// run is widened to whole kDeltaBlock blocks and only those blocks are rewritten,
+// then the length is fixed up.
+static bool WriteAt(HANDLE h, uint64_t offset, const char* data, uint64_t length, std::error_code& ec) {
+    while (length) {
+        OVERLAPPED ov{};
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD chunk = (DWORD)std::min<uint64_t>(length, 1u << 30), put = 0;
+        if (!WriteFile(h, data, chunk, &put, &ov)) { ec = LastError(); return false; }
+        offset += put; data += put; length -= put;
+    }
+    return true;
+}
+
+bool DeltaWriteFile(const std::wstring& path, const char* data, size_t size, const FileStamp& stamp,
+                    std::error_code& ec, const IoOptions& io, PhaseClock* clock) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL | io.TargetFlags(), nullptr);
+    if (h == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+    ApplyIoPriority(h, io.priority);
+
+    LARGE_INTEGER cur{};
+    if (!GetFileSizeEx(h, &cur)) { ec = LastError(); CloseHandle(h); return false; }
+    const uint64_t oldSize = (uint64_t)cur.QuadPart, newSize = size;
+    const uint64_t common = std::min(oldSize, newSize);
+
+    // Collect differing runs first: the view must be gone before SetEndOfFile. Both
+    // lists are kept per thread, so a repeat restore reuses their storage.
+    thread_local std::vector<ByteRange> runs, diffs;
+    runs.clear();
+    if (common) {
+        HANDLE map = CreateFileMappingW(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const char* view = map ? (const char*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view) {
+            ec = LastError();
+            if (map) CloseHandle(map);
+            CloseHandle(h);
+            return false;
+        }
+        // Whole blocks around each differing run, so the cache is written in pages.
+        DiffRanges(view, (size_t)common, data, (size_t)common, kDeltaBlock, diffs);
+        for (const auto& d : diffs) {
+            const uint64_t off = d.offset / kDeltaBlock * kDeltaBlock;
+            const uint64_t end = std::min<uint64_t>((d.offset + d.length + kDeltaBlock - 1) / kDeltaBlock * kDeltaBlock, common);
+            if (!runs.empty() && runs.back().offset + runs.back().length >= off) runs.back().length = end - runs.back().offset;
+            else runs.push_back({ off, end - off });
+        }
+        UnmapViewOfFile(view);
+        CloseHandle(map);
+    }
+    if (newSize > common) runs.push_back({ common, newSize - common }); // grown tail
+
+    for (const auto& r : runs) {
+        if (!WriteAt(h, r.offset, data + r.offset, r.length, ec)) break;
+    }
+    if (!ec && oldSize != newSize) {
+        LARGE_INTEGER end{};
+        end.QuadPart = (LONGLONG)newSize;
+        if (!SetFilePointerEx(h, end, nullptr, FILE_BEGIN) || !SetEndOfFile(h)) ec = LastError();
+    }
+    if (!ec) {
+        FILETIME ft = FromTicks(stamp.lastWrite);
+        SetFileTime(h, nullptr, nullptr, &ft);
+        FinishWrites(h, io, clock, ec);
+    }
+    CloseHandle(h);
+    return !ec;
+}
+
+// ---------- binary diff ----------
+namespace {
+// First index in [i, n) where the bytes differ (differ = true) or agree (false), else n.
+using ScanFn = size_t (*)(const char* a, const char* b, size_t i, size_t n, bool differ);
+
+size_t ScanScalar(const char* a, const char* b, size_t i, size_t n, bool differ) {
+    if (differ) { // equal words are the common case
+        for (; i + 8 <= n; i += 8) {
+            uint64_t x, y;
+            std::memcpy(&x, a + i, 8);
+            std::memcpy(&y, b + i, 8);
+            if (x != y) break;
+        }
+    }
+    for (; i < n; ++i) {
+        if ((a[i] != b[i]) == differ) return i;
+    }
+    return n;
+}
+
+#if DZ_X86
+unsigned LowestBit(uint32_t mask) {
+    unsigned long index = 0;
+    _BitScanForward(&index, mask);
+    return (unsigned)index;
+}
+
+size_t ScanSse2(const char* a, const char* b, size_t i, size_t n, bool differ) {
+    for (; i + 16 <= n; i += 16) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        const __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        const uint32_t equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+        const uint32_t hit = differ ? ~equal & 0xffff : equal;
+        if (hit) return i + LowestBit(hit);
+    }
+    return ScanScalar(a, b, i, n, differ);
+}
+
+// Two vectors per step while skipping equal bytes; differing runs are short, so the
+// other direction takes one at a time.
+size_t ScanAvx2(const char* a, const char* b, size_t i, size_t n, bool differ) {
+    if (differ) {
+        for (; i + 64 <= n; i += 64) {
+            const __m256i e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                                 _mm256_loadu_si256((const __m256i*)(b + i)));
+            const __m256i e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 32)),
+                                                 _mm256_loadu_si256((const __m256i*)(b + i + 32)));
+            if ((uint32_t)_mm256_movemask_epi8(_mm256_and_si256(e0, e1)) != 0xffffffffu) break;
+        }
+    }
+    for (; i + 32 <= n; i += 32) {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        const __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        const uint32_t equal = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        const uint32_t hit = differ ? ~equal : equal;
+        if (hit) return i + LowestBit(hit);
+    }
+    return ScanSse2(a, b, i, n, differ);
+}
+#endif
+
+struct DiffEngine {
+    ScanFn scan;
+    const char* name;
+};
+
+const DiffEngine& Engine() {
+    static const DiffEngine engine = []() -> DiffEngine {
+#if DZ_X86
+        if (IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE)) return { ScanAvx2, "avx2" }; // includes OS YMM support
+        if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE)) return { ScanSse2, "sse2" };
+#endif
+        return { ScanScalar, "scalar" };
+    }();
+    return engine;
+}
+
+// Read-only bytes of one slot: a mapping of its file, or its entry in a .dzpack.
+struct SlotBytes {
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE map = nullptr;
+    const char* view = nullptr;
+    std::shared_ptr<const PackFile> pack;
+    std::vector<char> scratch;
+    const char* data = nullptr;
+    size_t size = 0;
+
+    SlotBytes() = default;
+    SlotBytes(const SlotBytes&) = delete;
+    SlotBytes& operator=(const SlotBytes&) = delete;
+    ~SlotBytes() {
+        if (view) UnmapViewOfFile(view);
+        if (map) CloseHandle(map);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+
+    bool Open(const fs::path& src, std::error_code& ec) {
+        std::wstring packPath, name;
+        if (SplitPackPath(src, packPath, name)) {
+            pack = OpenPack(packPath, ec);
+            const PackEntry* e = pack ? pack->Find(name) : nullptr;
+            if (!e) {
+                if (!ec) ec = std::make_error_code(std::errc::no_such_file_or_directory);
+                return false;
+            }
+            size = (size_t)e->size;
+            return pack->Contents(*e, data, scratch, ec);
+        }
+        if (IsSlotGroup(src)) { ec = std::make_error_code(std::errc::is_a_directory); return false; }
+
+        file = CreateFileW(src.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+        LARGE_INTEGER len{};
+        if (!GetFileSizeEx(file, &len)) { ec = LastError(); return false; }
+        size = (size_t)len.QuadPart;
+        if (size == 0) return true; // nothing to map
+        map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        view = map ? (const char*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view) { ec = LastError(); return false; }
+        data = view;
+        return true;
+    }
+};
+
+std::string HexBytes(const char* p, size_t n) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(n * 3);
+    for (size_t i = 0; i < n; ++i) {
+        if (i) out += ' ';
+        out += kDigits[(unsigned char)p[i] >> 4];
+        out += kDigits[(unsigned char)p[i] & 15];
+    }
+    return out;
+}
+} // namespace
+
+const char* DiffEngineName() { return Engine().name; }
+
+void DiffRanges(const char* a, size_t aSize, const char* b, size_t bSize, size_t mergeGap,
+                std::vector<ByteRange>& out) {
+    out.clear();
+    const ScanFn scan = Engine().scan;
+    const size_t common = std::min(aSize, bSize);
+    auto add = [&](uint64_t start, uint64_t end) {
+        if (!out.empty() && start - (out.back().offset + out.back().length) <= mergeGap) {
+            out.back().length = end - out.back().offset;
+        } else {
+            out.push_back({ start, end - start });
+        }
+    };
+    for (size_t i = scan(a, b, 0, common, true); i < common;) {
+        const size_t end = scan(a, b, i, common, false);
+        add(i, end);
+        i = scan(a, b, end, common, true);
+    }
+    if (aSize != bSize) add(common, std::max(aSize, bSize));
+}
+
+uint64_t SlotDiff::Differing() const {
+    uint64_t total = 0;
+    for (const auto& r : ranges) total += r.length;
+    return total;
+}
+
+bool SlotDiff::WriteCsv(std::ostream& out) const {
+    out << "offset,length,a,b\n";
+    char offset[24];
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        snprintf(offset, sizeof(offset), "0x%llx", (unsigned long long)ranges[i].offset);
+        out << offset << ',' << ranges[i].length << ',' << hexA[i] << ',' << hexB[i] << '\n';
+    }
+    return (bool)out;
+}
+
+bool DiffSlots(const fs::path& a, const fs::path& b, size_t mergeGap, SlotDiff& out, std::error_code& ec) {
+    ec.clear();
+    out = SlotDiff{};
+    SlotBytes sa, sb;
+    if (!sa.Open(a, ec) || !sb.Open(b, ec)) return false;
+    out.sizeA = sa.size;
+    out.sizeB = sb.size;
+    DiffRanges(sa.data, sa.size, sb.data, sb.size, mergeGap, out.ranges);
+
+    out.hexA.reserve(out.ranges.size());
+    out.hexB.reserve(out.ranges.size());
+    auto preview = [](const SlotBytes& s, uint64_t offset) {
+        return offset < s.size ? HexBytes(s.data + offset, (size_t)std::min<uint64_t>(kDiffPreview, s.size - offset))
+                               : std::string();
+    };
+    for (const auto& r : out.ranges) {
+        out.hexA.push_back(preview(sa, r.offset));
+        out.hexB.push_back(preview(sb, r.offset));
+    }
+    return true;
+}
+
+// ---------- slot archive (.dzpack) ----------
+namespace {
+constexpr char kPackMagic[8] = { 'D', 'Z', 'P', 'A', 'C', 'K', '1', 0 };
+constexpr size_t kPackHeader = sizeof(kPackMagic) + 8;
+constexpr size_t kPackEntryFixed = 4 * 8 + 4 + 2; // before the name
+constexpr uint64_t kPackMaxSlot = 1ull << 30;     // larger entries are corrupt, not saves
+
+struct Decompressor {
+    DECOMPRESSOR_HANDLE h = nullptr;
+    Decompressor() { CreateDecompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &h); }
+    ~Decompressor() { if (h) CloseDecompressor(h); }
+};
+struct Compressor {
+    COMPRESSOR_HANDLE h = nullptr;
+    Compressor() { CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &h); }
+    ~Compressor() { if (h) CloseCompressor(h); }
+};
+} // namespace
+
+PackFile::~PackFile() {
+    if (view_) UnmapViewOfFile(view_);
+    if (map_) CloseHandle(map_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+}
+
+bool PackFile::Open(const std::wstring& path, std::error_code& ec) {
+    // FILE_SHARE_DELETE: a fresh pack can still be renamed over this one.
+    file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+
+    BY_HANDLE_FILE_INFORMATION info{};
+    if (!GetFileInformationByHandle(file_, &info)) { ec = LastError(); return false; }
+    stamp_.size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    stamp_.lastWrite = ToTicks(info.ftLastWriteTime);
+    if (stamp_.size < kPackHeader) { ec = std::make_error_code(std::errc::invalid_argument); return false; }
+
+    map_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    view_ = map_ ? (const char*)MapViewOfFile(map_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view_) { ec = LastError(); return false; }
+
+    Reader r{ view_, view_ + stamp_.size };
+    char magic[sizeof(kPackMagic)];
+    uint32_t count = 0, reserved = 0;
+    if (!r.GetArray(magic, sizeof(magic)) || std::memcmp(magic, kPackMagic, sizeof(magic)) != 0 ||
+        !r.Get(count) || !r.Get(reserved)) {
+        ec = std::make_error_code(std::errc::invalid_argument);
+        return false;
+    }
+    // The header's count is untrusted: a corrupt one must fail here, not in reserve().
+    if (count > (stamp_.size - kPackHeader) / kPackEntryFixed) {
+        ec = std::make_error_code(std::errc::invalid_argument);
+        return false;
+    }
+    entries_.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        PackEntry e;
+        uint16_t nameLen = 0;
+        if (!r.Get(e.offset) || !r.Get(e.stored) || !r.Get(e.size) || !r.Get(e.hash) || !r.Get(e.codec) ||
+            !r.Get(nameLen)) {
+            break;
+        }
+        e.name.resize(nameLen);
+        if (!r.GetArray(e.name.data(), nameLen)) break;
+        if (e.offset > stamp_.size || e.stored > stamp_.size - e.offset) break; // blob outside the file
+        if (e.codec == kPackStored && e.stored != e.size) break;
+        if (e.size > kPackMaxSlot) break; // Contents() sizes its scratch buffer from it
+        byName_.emplace(e.name, entries_.size());
+        entries_.push_back(std::move(e));
+    }
+    if (entries_.size() != count) {
+        ec = std::make_error_code(std::errc::invalid_argument);
+        return false;
+    }
+    return true;
+}
+
+const PackEntry* PackFile::Find(const std::wstring& name) const {
+    auto it = byName_.find(name);
+    return it == byName_.end() ? nullptr : &entries_[it->second];
+}
+
+bool PackFile::Contents(const PackEntry& e, const char*& out, std::vector<char>& scratch, std::error_code& ec) const {
+    const char* blob = view_ + e.offset;
+    if (e.codec == kPackStored) {
+        out = blob;
+        return true;
+    }
+    static thread_local Decompressor decompressor; // one per worker thread
+    SIZE_T got = 0;
+    scratch.resize((size_t)e.size);
+    if (e.codec != kPackXpressHuff || !decompressor.h ||
+        !Decompress(decompressor.h, blob, (SIZE_T)e.stored, scratch.data(), scratch.size(), &got) ||
+        got != scratch.size()) {
+        ec = std::make_error_code(std::errc::illegal_byte_sequence);
+        return false;
+    }
+    out = scratch.data();
+    return true;
+}
+
+bool IsPackPath(std::wstring_view folder) {
+    constexpr std::wstring_view kExt = L".dzpack";
+    return folder.size() > kExt.size() &&
+           CompareStringOrdinal(folder.data() + folder.size() - kExt.size(), (int)kExt.size(), kExt.data(),
+                                (int)kExt.size(), TRUE) == CSTR_EQUAL;
+}
+
+fs::path SlotDir(const std::wstring& folder) {
+    return IsPackPath(folder) ? fs::path(folder).parent_path() : fs::path(folder);
+}
+
+// Checked in place on src's string: a plain slot builds no parent path.
+bool SplitPackPath(const fs::path& src, std::wstring& pack, std::wstring& name) {
+    const std::wstring& s = src.native();
+    const size_t slash = s.find_last_of(L"\\/");
+    if (slash == std::wstring::npos || !IsPackPath(std::wstring_view(s).substr(0, slash))) return false;
+    pack.assign(s, 0, slash);
+    name.assign(s, slash + 1, std::wstring::npos);
+    return true;
+}
+
+// The mapping is kept between restores, so a restore from the archive is a page-in
+// and a write. Replaced when the file on disk changes.
+std::shared_ptr<const PackFile> OpenPack(const std::wstring& path, std::error_code& ec) {
+    static std::mutex mutex;
+    static std::wstring openPath;
+    static std::shared_ptr<const PackFile> open;
+
+    FileStamp stamp;
+    if (!StatFile(path, stamp, ec)) return nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (open && openPath == path && open->Stamp() == stamp) return open;
+
+    auto pack = std::make_shared<PackFile>();
+    if (!pack->Open(path, ec)) return nullptr;
+    open = pack;
+    openPath = path;
+    return open;
+}
+
+bool WritePack(const std::wstring& folder, const std::wstring& out, bool compress, size_t& count,
+               std::error_code& ec, const std::wstring& pattern) {
+    ec.clear();
+    count = 0;
+    std::vector<SlotEntry> files;
+    EnumerateSlotFiles(folder, files, [] { return false; }, pattern);
+    files.erase(std::remove_if(files.begin(), files.end(), // groups stay folders
+                               [&](const SlotEntry& f) { return IsSlotGroup(fs::path(folder) / f.name); }),
+                files.end());
+
+    std::vector<PackEntry> entries;
+    uint64_t offset = kPackHeader;
+    for (const auto& f : files) offset += kPackEntryFixed + f.name.size() * sizeof(wchar_t);
+
+    fs::path temp = TempPathFor(fs::path(out), L"tmp");
+    HANDLE h = CreateFileW(temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+
+    Compressor compressor;
+    std::vector<char> data, packed;
+    for (const auto& f : files) {
+        FileStamp stamp;
+        if (!ReadWholeFile((fs::path(folder) / f.name).native(), data, stamp, ec)) break;
+        if (data.size() > kPackMaxSlot) { ec = std::make_error_code(std::errc::file_too_large); break; }
+
+        PackEntry e;
+        e.name = f.name;
+        e.offset = offset;
+        e.size = data.size();
+        e.hash = Hash64(data.data(), data.size());
+        const char* blob = data.data();
+        e.stored = data.size();
+        SIZE_T packedSize = 0;
+        if (compress && compressor.h && !data.empty()) {
+            packed.resize(data.size());
+            if (Compress(compressor.h, data.data(), data.size(), packed.data(), packed.size(), &packedSize) &&
+                packedSize < data.size()) {
+                e.codec = kPackXpressHuff;
+                e.stored = packedSize;
+                blob = packed.data();
+            }
+        }
+        if (!WriteAt(h, e.offset, blob, e.stored, ec)) break;
+        offset += e.stored;
+        entries.push_back(std::move(e));
+    }
+
+    if (!ec) {
+        std::vector<char> index(kPackMagic, kPackMagic + sizeof(kPackMagic));
+        Put<uint32_t>(index, (uint32_t)entries.size());
+        Put<uint32_t>(index, 0);
+        for (const auto& e : entries) {
+            Put(index, e.offset);
+            Put(index, e.stored);
+            Put(index, e.size);
+            Put(index, e.hash);
+            Put(index, e.codec);
+            Put<uint16_t>(index, (uint16_t)e.name.size());
+            PutWide(index, e.name);
+        }
+        WriteAt(h, 0, index.data(), index.size(), ec);
+    }
+    CloseHandle(h);
+    if (ec || !SwapIntoPlace(temp, fs::path(out), ec)) {
+        DeleteFileW(temp.c_str());
+        return false;
+    }
+    count = entries.size();
+    return true;
+}
+
+// ---------- restore ----------
+const char* RestoreModeName(RestoreMode m) {
+    switch (m) {
+    case RestoreMode::CopyEx: return "copyex";
+    case RestoreMode::Delta:  return "delta";
+    case RestoreMode::Atomic: return "atomic";
+    default:                  return "copy";
+    }
+}
+RestoreMode ParseRestoreMode(const std::string& s) {
+    if (s == "copyex") return RestoreMode::CopyEx;
+    if (s == "delta")  return RestoreMode::Delta;
+    if (s == "atomic") return RestoreMode::Atomic;
+    return RestoreMode::Copy;
+}
+
+// Temp files start with "~dz_", which IsSlotName rejects whatever the pattern.
+fs::path TempPathFor(const fs::path& dest, const wchar_t* tag) {
+    return dest.parent_path() / (L"~dz_" + dest.filename().native() + L"." + tag);
+}
+
+// The only moment the game can see is the rename itself: the target is either the
+// old file or the complete new one, never a half-written mix.
+bool SwapIntoPlace(const fs::path& temp, const fs::path& dest, std::error_code& ec, bool keepTemp) {
+    if (MoveFileExW(temp.c_str(), dest.c_str(), MOVEFILE_REPLACE_EXISTING)) return true;
+    ec = LastError();
+    if (!keepTemp) DeleteFileW(temp.c_str());
+    return false;
+}
+
+// ---------- backup ring ----------
+BackupRing g_backups;
+
+namespace {
+// Ring members of dest, oldest first.
+std::vector<std::pair<uint64_t, fs::path>> ListBackups(const fs::path& dest) {
+    std::vector<std::pair<uint64_t, fs::path>> out;
+    const std::wstring prefix = dest.filename().native() + L".";
+    std::error_code ec;
+    for (fs::directory_iterator it(BackupRing::Dir(dest), ec), end; !ec && it != end; it.increment(ec)) {
+        const std::wstring name = it->path().filename().native();
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+        if (!std::all_of(name.begin() + prefix.size(), name.end(), [](wchar_t c) { return c >= L'0' && c <= L'9'; })) {
+            continue;
+        }
+        out.emplace_back(std::wcstoull(name.c_str() + prefix.size(), nullptr, 10), it->path());
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// Shares src's extents with a new dst (FSCTL_DUPLICATE_EXTENTS_TO_FILE). False with ec
+// clear when the volume has no block cloning, so the caller can copy instead.
+bool CloneFile(const fs::path& src, const fs::path& dst, std::error_code& ec) {
+    HANDLE in = CreateFileW(src.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, 0, nullptr);
+    if (in == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+    DWORD fsFlags = 0;
+    BY_HANDLE_FILE_INFORMATION info{};
+    FSCTL_GET_INTEGRITY_INFORMATION_BUFFER integrity{};
+    DWORD got = 0;
+    if (!GetVolumeInformationByHandleW(in, nullptr, 0, nullptr, nullptr, &fsFlags, nullptr, 0) ||
+        !(fsFlags & FILE_SUPPORTS_BLOCK_REFCOUNTING) || !GetFileInformationByHandle(in, &info) ||
+        !DeviceIoControl(in, FSCTL_GET_INTEGRITY_INFORMATION, nullptr, 0, &integrity, sizeof(integrity), &got,
+                         nullptr)) {
+        CloseHandle(in);
+        return false;
+    }
+
+    HANDLE out = CreateFileW(dst.c_str(), GENERIC_READ | GENERIC_WRITE | DELETE, 0, nullptr, CREATE_NEW,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (out == INVALID_HANDLE_VALUE) { ec = LastError(); CloseHandle(in); return false; }
+
+    // Both ends must agree on sparseness and integrity streams, and clone whole
+    // clusters; the tail may round up past the end of the (already sized) target.
+    const uint64_t size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    const uint64_t cluster = integrity.ClusterSizeInBytes ? integrity.ClusterSizeInBytes : 4096;
+    bool ok = true;
+    if (info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE) {
+        ok = DeviceIoControl(out, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &got, nullptr) != 0;
+    }
+    FSCTL_SET_INTEGRITY_INFORMATION_BUFFER setIntegrity{ integrity.ChecksumAlgorithm, 0, integrity.Flags };
+    ok = ok && DeviceIoControl(out, FSCTL_SET_INTEGRITY_INFORMATION, &setIntegrity, sizeof(setIntegrity), nullptr, 0,
+                               &got, nullptr);
+    FILE_END_OF_FILE_INFO eof{};
+    eof.EndOfFile.QuadPart = (LONGLONG)size;
+    ok = ok && SetFileInformationByHandle(out, FileEndOfFileInfo, &eof, sizeof(eof));
+    const uint64_t total = (size + cluster - 1) / cluster * cluster;
+    constexpr uint64_t kMaxClone = 1ull << 31; // ByteCount must stay below 4 GiB per call
+    for (uint64_t off = 0; ok && off < total; off += kMaxClone) {
+        DUPLICATE_EXTENTS_DATA dup{};
+        dup.FileHandle = in;
+        dup.SourceFileOffset.QuadPart = (LONGLONG)off;
+        dup.TargetFileOffset.QuadPart = (LONGLONG)off;
+        dup.ByteCount.QuadPart = (LONGLONG)std::min(kMaxClone, total - off);
+        ok = DeviceIoControl(out, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &dup, sizeof(dup), nullptr, 0, &got, nullptr) != 0;
+    }
+    if (!ok) {
+        ec = LastError();
+        FILE_DISPOSITION_INFO del{ TRUE };
+        SetFileInformationByHandle(out, FileDispositionInfo, &del, sizeof(del));
+    }
+    CloseHandle(out);
+    CloseHandle(in);
+    return ok;
+}
+} // namespace
+
+fs::path BackupRing::NextLocked(const fs::path& dest, std::error_code& ec) {
+    auto existing = ListBackups(dest);
+    const uint64_t n = existing.empty() ? 1 : existing.back().first + 1;
+    if (!CreateDirectoryW(Dir(dest).c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS) ec = LastError();
+    return Dir(dest) / (dest.filename().native() + L"." + std::to_wstring(n));
+}
+
+void BackupRing::TrimLocked(const fs::path& dest) {
+    auto existing = ListBackups(dest);
+    for (size_t i = 0; i + Depth() < existing.size(); ++i) DeleteFileW(existing[i].second.c_str());
+}
+
+bool BackupRing::Take(const fs::path& dest, std::error_code& ec) {
+    if (!Depth() || GetFileAttributesW(dest.c_str()) == INVALID_FILE_ATTRIBUTES) return true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    const fs::path backup = NextLocked(dest, ec);
+    if (ec) return false;
+
+    // Only Swap moves the old target aside, and then as part of its rename.
+    bool ok = CloneFile(dest, backup, ec);
+    if (!ok && !ec) ok = CopyFileW(dest.c_str(), backup.c_str(), TRUE) != 0;
+    if (!ok) {
+        if (!ec) ec = LastError();
+        return false;
+    }
+    TrimLocked(dest);
+    return true;
+}
+
+bool BackupRing::Swap(const fs::path& temp, const fs::path& dest, std::error_code& ec, bool keepTemp) {
+    if (!Depth() || GetFileAttributesW(dest.c_str()) == INVALID_FILE_ATTRIBUTES) {
+        return SwapIntoPlace(temp, dest, ec, keepTemp);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    const fs::path backup = NextLocked(dest, ec);
+    if (ec) {
+        if (!keepTemp) DeleteFileW(temp.c_str());
+        return false;
+    }
+    if (ReplaceFileW(dest.c_str(), temp.c_str(), backup.c_str(), REPLACEFILE_IGNORE_MERGE_ERRORS, nullptr, nullptr)) {
+        TrimLocked(dest);
+        return true;
+    }
+    const DWORD err = GetLastError();
+    if (err == ERROR_UNABLE_TO_MOVE_REPLACEMENT_2) MoveFileExW(backup.c_str(), dest.c_str(), 0); // old target back
+    ec = std::error_code((int)err, std::system_category());
+    if (!keepTemp) DeleteFileW(temp.c_str());
+    return false;
+}
+
+bool BackupRing::Undo(const fs::path& dest, std::error_code& ec) {
+    ec.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto existing = ListBackups(dest);
+    if (existing.empty()) return false;
+    if (MoveFileExW(existing.back().second.c_str(), dest.c_str(), MOVEFILE_REPLACE_EXISTING)) return true;
+    ec = LastError();
+    return false;
+}
+
+void BackupRing::Adopt(const fs::path& old, const fs::path& dest) {
+    if (Depth()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::error_code ec;
+        const fs::path backup = NextLocked(dest, ec);
+        if (!ec && MoveFileExW(old.c_str(), backup.c_str(), 0)) {
+            TrimLocked(dest);
+            return;
+        }
+    }
+    DeleteFileW(old.c_str());
+}
+
+// ---------- slot groups ----------
+bool IsSlotGroup(const fs::path& src) {
+    DWORD attr = GetFileAttributesW(src.c_str());
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+std::vector<std::wstring> GroupFiles(const fs::path& src) {
+    std::vector<std::wstring> names;
+    std::error_code ec;
+    for (fs::directory_iterator it(src, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec)) names.push_back(it->path().filename().native());
+    }
+    std::sort(names.begin(), names.end(), NaturalLess);
+    return names;
+}
+
+namespace {
+constexpr DWORD kGroupChunk = 1u << 20;
+
+// One file of a group in flight: alternately a read from the slot and a write of
+// the same bytes to the temp, both overlapped and completed through one port.
+struct GroupCopy {
+    fs::path dest, temp, old;
+    HANDLE in = INVALID_HANDLE_VALUE, out = INVALID_HANDLE_VALUE;
+    uint64_t size = 0, offset = 0;
+    FILETIME lastWrite{};
+    std::vector<char> buffer;
+    OVERLAPPED ov{};
+    bool writing = false;
+    bool hadOld = false;
+
+    GroupCopy() = default;
+    GroupCopy(const GroupCopy&) = delete;
+    ~GroupCopy() {
+        if (in != INVALID_HANDLE_VALUE) CloseHandle(in);
+        if (out != INVALID_HANDLE_VALUE) CloseHandle(out);
+    }
+    void Seek(uint64_t at) {
+        ov = OVERLAPPED{};
+        ov.Offset = (DWORD)at;
+        ov.OffsetHigh = (DWORD)(at >> 32);
+    }
+    bool Issue(HANDLE h, DWORD bytes, bool write) {
+        Seek(offset);
+        writing = write;
+        BOOL ok = write ? WriteFile(h, buffer.data(), bytes, nullptr, &ov) : ReadFile(h, buffer.data(), bytes, nullptr, &ov);
+        return ok || GetLastError() == ERROR_IO_PENDING; // either way the port gets the completion
+    }
+    DWORD NextRead() const { return (DWORD)std::min<uint64_t>(size - offset, kGroupChunk); }
+};
+
+bool OpenGroupCopy(GroupCopy& f, const fs::path& src, const IoOptions& io, HANDLE port, ULONG_PTR key,
+                   std::error_code& ec) {
+    f.in = CreateFileW(src.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                       OPEN_EXISTING, FILE_FLAG_OVERLAPPED | io.SourceFlags(), nullptr);
+    if (f.in == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+    f.out = CreateFileW(f.temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | io.TargetFlags(), nullptr);
+    if (f.out == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+    ApplyIoPriority(f.in, io.priority);
+    ApplyIoPriority(f.out, io.priority);
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(f.in, &size) || !GetFileTime(f.in, nullptr, nullptr, &f.lastWrite) ||
+        !CreateIoCompletionPort(f.in, port, key, 0) || !CreateIoCompletionPort(f.out, port, key, 0)) {
+        ec = LastError();
+        return false;
+    }
+    f.size = (uint64_t)size.QuadPart;
+    f.buffer.resize(std::max<size_t>(1, (size_t)std::min<uint64_t>(f.size, kGroupChunk)));
+    return true;
+}
+
+// Copies every file of the group into its temp concurrently, so the group takes
+// about as long as its largest file.
+bool CopyGroup(const fs::path& src, const std::vector<std::wstring>& names, const IoOptions& io,
+               std::vector<std::unique_ptr<GroupCopy>>& files, std::error_code& ec, PhaseClock& clock) {
+    HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+    if (!port) { ec = LastError(); return false; }
+
+    size_t inFlight = 0;
+    for (size_t i = 0; i < files.size() && !ec; ++i) {
+        GroupCopy& f = *files[i];
+        if (!OpenGroupCopy(f, src / names[i], io, port, i, ec)) break;
+        if (f.size == 0) continue;
+        if (!f.Issue(f.in, f.NextRead(), false)) { ec = LastError(); break; }
+        ++inFlight;
+    }
+
+    // After an error nothing new is issued; the rest is cancelled and drained before
+    // the buffers go away.
+    bool cancelled = false;
+    while (inFlight) {
+        if (ec && !cancelled) {
+            for (auto& f : files) {
+                if (f->in != INVALID_HANDLE_VALUE) CancelIoEx(f->in, nullptr);
+                if (f->out != INVALID_HANDLE_VALUE) CancelIoEx(f->out, nullptr);
+            }
+            cancelled = true;
+        }
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* ov = nullptr;
+        BOOL ok = GetQueuedCompletionStatus(port, &bytes, &key, &ov, INFINITE);
+        if (!ov) { if (!ec) ec = LastError(); break; } // the port itself failed
+        --inFlight;
+        GroupCopy& f = *files[key];
+        if (!ok && !ec) ec = LastError();
+        if (ec) continue;
+
+        if (!f.writing) {
+            if (bytes == 0) { ec = std::make_error_code(std::errc::io_error); continue; } // shrank under us
+            if (!f.Issue(f.out, bytes, true)) { ec = LastError(); continue; }
+            ++inFlight;
+        } else {
+            f.offset += bytes;
+            if (f.offset >= f.size) continue;
+            if (!f.Issue(f.in, f.NextRead(), false)) { ec = LastError(); continue; }
+            ++inFlight;
+        }
+    }
+    clock.Mark(kSeriesWrite);
+    for (auto& f : files) { // all temps durable (under flush) before any rename
+        if (!ec && f->out != INVALID_HANDLE_VALUE) {
+            SetFileTime(f->out, nullptr, nullptr, &f->lastWrite);
+            if (io.flush == FlushMode::Flush && !FlushFileBuffers(f->out)) ec = LastError();
+        }
+    }
+    clock.Mark(kSeriesFlush);
+    for (auto& f : files) {
+        if (f->in != INVALID_HANDLE_VALUE) CloseHandle(f->in);
+        if (f->out != INVALID_HANDLE_VALUE) CloseHandle(f->out);
+        f->in = f->out = INVALID_HANDLE_VALUE;
+    }
+    CloseHandle(port);
+    return !ec;
+}
+
+// Every temp is complete before the first rename, so the only window in which the
+// game could see old and new files mixed is a handful of renames. If one fails, the
+// targets already switched are put back.
+bool CommitGroup(std::vector<std::unique_ptr<GroupCopy>>& files, std::error_code& ec) {
+    size_t committed = 0;
+    for (; committed < files.size(); ++committed) {
+        GroupCopy& f = *files[committed];
+        f.hadOld = GetFileAttributesW(f.dest.c_str()) != INVALID_FILE_ATTRIBUTES;
+        if (f.hadOld && !MoveFileExW(f.dest.c_str(), f.old.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            ec = LastError();
+            break;
+        }
+        if (!MoveFileExW(f.temp.c_str(), f.dest.c_str(), 0)) {
+            ec = LastError();
+            if (f.hadOld) MoveFileExW(f.old.c_str(), f.dest.c_str(), 0);
+            break;
+        }
+    }
+    if (ec) {
+        while (committed--) {
+            GroupCopy& f = *files[committed];
+            if (f.hadOld) MoveFileExW(f.old.c_str(), f.dest.c_str(), MOVEFILE_REPLACE_EXISTING);
+            else DeleteFileW(f.dest.c_str());
+        }
+        return false;
+    }
+    for (auto& f : files) {
+        if (f->hadOld) g_backups.Adopt(f->old, f->dest);
+    }
+    return true;
+}
+} // namespace
+
+// Groups are always copied to temps and renamed in: the restore mode and RAM cache
+// apply to single-file slots only.
+static void RestoreGroup(const fs::path& src, const fs::path& destDir, const IoOptions& io, std::error_code& ec,
+                         PhaseClock& clock) {
+    const auto names = GroupFiles(src);
+    clock.Mark(kSeriesRead);
+    if (names.empty()) { ec = std::make_error_code(std::errc::no_such_file_or_directory); return; }
+
+    std::vector<std::unique_ptr<GroupCopy>> files;
+    for (const auto& name : names) {
+        auto f = std::make_unique<GroupCopy>();
+        f->dest = destDir / name;
+        f->temp = TempPathFor(f->dest, L"tmp");
+        f->old = TempPathFor(f->dest, L"old");
+        files.push_back(std::move(f));
+    }
+    bool copied = CopyGroup(src, names, io, files, ec, clock);
+    if (copied) CommitGroup(files, ec);
+    if (ec) {
+        for (auto& f : files) DeleteFileW(f->temp.c_str());
+    }
+    clock.Mark(kSeriesRename);
+}
+
+// Slot contents via the RAM cache when enabled, else freshly read.
+bool LoadSlot(const std::wstring& src, SaveBlob& data, FileStamp& stamp, std::error_code& ec,
+              const IoOptions& io) {
+    if (!StatFile(src, stamp, ec)) return false;
+    data = g_cache.Find(src, stamp);
+    if (data) return true;
+
+    auto bytes = std::make_shared<std::vector<char>>();
+    if (!ReadWholeFile(src, *bytes, stamp, ec, io)) return false;
+    data = bytes;
+    if (g_cache.Enabled()) { // the hash dedupes the cache and primes verification
+        uint64_t hash = Hash64(bytes->data(), bytes->size());
+        g_hashes.Insert(src, stamp, hash);
+        data = g_cache.Insert(src, stamp, data, hash);
+    }
+    return true;
+}
+
+// Buffered on purpose: the point is to leave the pages in the cache the restore reads.
+static bool PrefetchFile(const std::wstring& path, const std::function<bool()>& cancelled, std::error_code& ec) {
+    constexpr DWORD kChunk = 256u << 10;
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) { ec = LastError(); return false; }
+    ApplyIoPriority(h, IoPriority::VeryLow);
+
+    thread_local std::vector<char> buf(kChunk);
+    bool finished = false;
+    while (!cancelled()) {
+        DWORD got = 0;
+        if (!ReadFile(h, buf.data(), kChunk, &got, nullptr)) { ec = LastError(); break; }
+        if (got == 0) { finished = true; break; }
+    }
+    CloseHandle(h);
+    return finished;
+}
+
+bool PrefetchSlot(const fs::path& src, const std::function<bool()>& cancelled, std::error_code& ec) {
+    ec.clear();
+    if (IsSlotGroup(src)) {
+        for (const auto& name : GroupFiles(src)) {
+            if (!PrefetchSlot(src / name, cancelled, ec)) return false;
+        }
+        return true;
+    }
+    if (g_cache.Enabled()) { // one read, and later restores skip the disk entirely
+        IoOptions io = CurrentIoOptions();
+        io.priority = IoPriority::VeryLow;
+        SaveBlob data;
+        FileStamp stamp;
+        return LoadSlot(src.native(), data, stamp, ec, io);
+    }
+    return PrefetchFile(src.native(), cancelled, ec);
+}
+
+// What an attempt that hit a busy target leaves for RestoreSlot's next one.
+struct RetryState {
+    bool backedUp = false; // the ring already holds this restore's old target
+    fs::path temp;         // atomic: the new bytes, complete, still waiting for the swap
+};
+
+// Copies src over dest. With the RAM cache enabled the source is read at most once
+// per change on disk; later restores only stat it and write from memory.
+// Atomic restores keep their backup through the swap itself.
+static bool BackupBeforeWrite(const fs::path& dest, RestoreMode mode, RetryState& retry, std::error_code& ec) {
+    if (mode == RestoreMode::Atomic || retry.backedUp) return true;
+    retry.backedUp = g_backups.Take(dest, ec);
+    return retry.backedUp;
+}
+
+// TempPathFor(dest, "tmp"), kept per thread: the I/O worker restoring over the same
+// target again builds no path.
+static const fs::path& RestoreTemp(const fs::path& dest) {
+    thread_local fs::path lastDest, temp;
+    if (dest.native() != lastDest.native()) {
+        lastDest = dest;
+        temp = TempPathFor(dest, L"tmp");
+    }
+    return temp;
+}
+
+// Without the RAM cache a slot is read into this thread's buffer, reused by the next
+// restore. A buffer grown past this is dropped at the next restore instead.
+constexpr size_t kKeptReadBuffer = 64u << 20;
+static std::vector<char>& ReadBuffer() {
+    thread_local std::vector<char> buffer;
+    if (buffer.capacity() > kKeptReadBuffer) std::vector<char>().swap(buffer);
+    return buffer;
+}
+
+// The atomic swap; on failure the temp is kept in retry for another attempt.
+static void SwapRestored(const fs::path& temp, const fs::path& dest, RetryState& retry, std::error_code& ec) {
+    if (g_backups.Swap(temp, dest, ec, true)) retry.temp.clear();
+    else retry.temp = temp;
+}
+
+// The slot's bytes, already in memory, onto the target the way mode says.
+static void WriteRestored(const fs::path& dest, const char* data, size_t size, const FileStamp& stamp,
+                          RestoreMode mode, const IoOptions& io, RetryState& retry, std::error_code& ec,
+                          PhaseClock& clock) {
+    if (mode == RestoreMode::Delta) {
+        DeltaWriteFile(dest.native(), data, size, stamp, ec, io, &clock);
+    } else if (mode == RestoreMode::Atomic) {
+        const fs::path& temp = RestoreTemp(dest);
+        bool written = WriteWholeFile(temp.native(), data, size, stamp, ec, io, &clock);
+        if (written) SwapRestored(temp, dest, retry, ec);
+        else DeleteFileW(temp.c_str());
+        clock.Mark(kSeriesRename);
+    } else {
+        WriteWholeFile(dest.native(), data, size, stamp, ec, io, &clock);
+    }
+}
+
+// Archive slots skip the RAM cache: the mapping already serves them from memory.
+static void RestoreFromPack(const std::wstring& packPath, const std::wstring& name, const fs::path& dest,
+                            RestoreMode mode, const IoOptions& io, RetryState& retry, std::error_code& ec,
+                            PhaseClock& clock) {
+    auto pack = OpenPack(packPath, ec);
+    if (!pack) return;
+    const PackEntry* e = pack->Find(name);
+    if (!e) { ec = std::make_error_code(std::errc::no_such_file_or_directory); return; }
+
+    const char* data = nullptr;
+    bool loaded = pack->Contents(*e, data, ReadBuffer(), ec);
+    clock.Mark(kSeriesRead);
+    if (!loaded || !BackupBeforeWrite(dest, mode, retry, ec)) return;
+
+    WriteRestored(dest, data, (size_t)e->size, FileStamp{ e->size, pack->Stamp().lastWrite }, mode, io, retry, ec,
+                  clock);
+}
+
+// One attempt of RestoreSlot.
+static void RestoreOnce(const fs::path& src, const fs::path& dest, RestoreMode mode, const IoOptions& io,
+                        RetryState& retry, std::error_code& ec, RestoreTiming* timing) {
+    ec.clear();
+    PhaseClock clock(timing);
+    if (!retry.temp.empty()) { // written last time; only the swap was refused
+        SwapRestored(retry.temp, dest, retry, ec);
+        clock.Mark(kSeriesRename);
+        return;
+    }
+    thread_local std::wstring pack, name;
+    if (SplitPackPath(src, pack, name)) {
+        RestoreFromPack(pack, name, dest, mode, io, retry, ec, clock);
+        return;
+    }
+    if (IsSlotGroup(src)) {
+        RestoreGroup(src, dest.parent_path(), io, ec, clock);
+        return;
+    }
+    // The system copy routines only while every option is at its default; otherwise
+    // the read-then-write path below, which opens both handles itself.
+    const bool systemCopy = !g_cache.Enabled() && io.IsDefault();
+    if (mode == RestoreMode::Atomic && systemCopy) {
+        const fs::path& temp = RestoreTemp(dest);
+        bool copied = CopyFileW(src.c_str(), temp.c_str(), FALSE) != 0;
+        clock.Mark(kSeriesWrite);
+        if (!copied) { ec = LastError(); return; }
+        SwapRestored(temp, dest, retry, ec);
+        clock.Mark(kSeriesRename);
+        return;
+    }
+    if (mode == RestoreMode::Copy && systemCopy) {
+        if (fs::exists(src, ec)) {
+            clock.Mark(kSeriesRead);
+            if (!BackupBeforeWrite(dest, mode, retry, ec)) return;
+            fs::copy_file(src, dest, fs::copy_options::overwrite_existing, ec);
+            clock.Mark(kSeriesWrite);
+        } else {
+            ec = std::make_error_code(std::errc::no_such_file_or_directory);
+        }
+        return;
+    }
+    // copyex stays CopyFileExW's own copy: only the flush option reaches it, as a
+    // flush of the finished target.
+    if (mode == RestoreMode::CopyEx && !g_cache.Enabled()) {
+        if (GetFileAttributesW(src.c_str()) == INVALID_FILE_ATTRIBUTES) { ec = LastError(); return; }
+        if (!BackupBeforeWrite(dest, mode, retry, ec)) return;
+        bool copied = CopyFileExW(src.c_str(), dest.c_str(), nullptr, nullptr, nullptr, 0) != 0;
+        if (!copied) {
+            ec = LastError();
+            clock.Mark(kSeriesWrite);
+            return;
+        }
+        if (io.flush != FlushMode::Lazy) {
+            HANDLE h = CreateFileW(dest.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr);
+            if (h == INVALID_HANDLE_VALUE) { ec = LastError(); return; }
+            IoOptions flushNow = io;
+            flushNow.flush = FlushMode::Flush;
+            FinishWrites(h, flushNow, &clock, ec);
+            CloseHandle(h);
+        }
+        clock.Mark(kSeriesWrite);
+        return;
+    }
+
+    FileStamp stamp;
+    if (g_cache.Enabled()) {
+        SaveBlob data;
+        bool loaded = LoadSlot(src.native(), data, stamp, ec, io);
+        clock.Mark(kSeriesRead);
+        if (!loaded || !BackupBeforeWrite(dest, mode, retry, ec)) return;
+        WriteRestored(dest, data->data(), data->size(), stamp, mode, io, retry, ec, clock);
+        return;
+    }
+    std::vector<char>& buffer = ReadBuffer();
+    bool loaded = ReadWholeFile(src.native(), buffer, stamp, ec, io);
+    clock.Mark(kSeriesRead);
+    if (!loaded || !BackupBeforeWrite(dest, mode, retry, ec)) return;
+    WriteRestored(dest, buffer.data(), buffer.size(), stamp, mode, io, retry, ec, clock);
+}
+
+bool IsTargetBusy(const std::error_code& ec, const fs::path& dest) {
+    if (ec.category() != std::system_category()) return false;
+    switch (ec.value()) {
+    case ERROR_SHARING_VIOLATION:
+    case ERROR_LOCK_VIOLATION:
+    case ERROR_USER_MAPPED_FILE:
+    case ERROR_UNABLE_TO_REMOVE_REPLACED:
+        return true;
+    case ERROR_ACCESS_DENIED: {
+        const DWORD attrs = GetFileAttributesW(dest.c_str());
+        return attrs != INVALID_FILE_ATTRIBUTES && !(attrs & (FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_DIRECTORY));
+    }
+    default:
+        return false;
+    }
+}
+
+void RestoreSlot(const fs::path& src, const fs::path& dest, RestoreMode mode, std::error_code& ec,
+                 RestoreTiming* timing) {
+    constexpr DWORD kFirstDelayMs = 1, kMaxDelayMs = 64;
+    const IoOptions io = CurrentIoOptions();
+    const int64_t start = QpcNow();
+    DWORD delay = kFirstDelayMs;
+    RetryState retry;
+    for (;;) {
+        const int64_t attempt = QpcNow();
+        RestoreOnce(src, dest, mode, io, retry, ec, timing);
+        // Done, failed for good, or out of budget: report the error as it stands.
+        if (!ec || !IsTargetBusy(ec, dest) || QpcToUs(QpcNow() - start) / 1000.0 + delay > io.shareWaitMs) {
+            if (!retry.temp.empty()) DeleteFileW(retry.temp.c_str());
+            return;
+        }
+
+        Sleep(delay);
+        delay = std::min(delay * 2, kMaxDelayMs);
+        if (timing) { // only the attempt that succeeds keeps its phases
+            RestoreTiming kept;
+            kept.ticks[kSeriesWait] = timing->ticks[kSeriesWait] + (QpcNow() - attempt);
+            *timing = kept;
+        }
+    }
+}
+
+// The source side is normally free: its hash is cached by stamp, and a slot still in
+// the RAM cache is hashed from memory rather than read again.
+bool VerifyRestore(const fs::path& src, const fs::path& dest, bool& matched, std::error_code& ec) {
+    matched = false;
+    if (IsSlotGroup(src)) { // every member against its own target
+        const auto names = GroupFiles(src);
+        for (const auto& name : names) {
+            bool same = false;
+            if (!VerifyRestore(src / name, dest.parent_path() / name, same, ec)) return false;
+            if (!same) return true;
+        }
+        matched = !names.empty();
+        return true;
+    }
+    FileStamp srcStamp;
+    uint64_t srcHash = 0;
+    thread_local std::wstring packPath, name;
+    if (SplitPackPath(src, packPath, name)) { // the archive index carries the hash
+        auto pack = OpenPack(packPath, ec);
+        const PackEntry* e = pack ? pack->Find(name) : nullptr;
+        if (!e) {
+            if (!ec) ec = std::make_error_code(std::errc::no_such_file_or_directory);
+            return false;
+        }
+        srcHash = e->hash;
+        srcStamp.size = e->size;
+    } else if (!StatFile(src.native(), srcStamp, ec)) {
+        return false;
+    } else if (!g_hashes.Find(src.native(), srcStamp, srcHash)) {
+        if (SaveBlob data = g_cache.Find(src.native(), srcStamp)) {
+            srcHash = Hash64(data->data(), data->size());
+        } else if (!HashFile(src.native(), srcHash, srcStamp, ec)) {
+            return false;
+        }
+        g_hashes.Insert(src.native(), srcStamp, srcHash);
+    }
+
+    uint64_t destHash = 0;
+    FileStamp destStamp;
+    if (!HashFile(dest.native(), destHash, destStamp, ec)) return false;
+    matched = destHash == srcHash && destStamp.size == srcStamp.size;
+    return true;
+}
+
+bool CaptureFile(const fs::path& src, const fs::path& dest, std::error_code& ec) {
+    ec.clear();
+    auto bytes = std::make_shared<std::vector<char>>();
+    FileStamp stamp;
+    if (!ReadWholeFile(src.native(), *bytes, stamp, ec)) return false;
+
+    fs::path temp = TempPathFor(dest, L"capture");
+    if (!WriteWholeFile(temp.native(), *bytes, stamp, ec)) {
+        DeleteFileW(temp.c_str());
+        return false;
+    }
+    if (!MoveFileExW(temp.c_str(), dest.c_str(), 0)) { // no REPLACE_EXISTING: never clobber a slot
+        ec = LastError();
+        DeleteFileW(temp.c_str());
+        return false;
+    }
+
+    const uint64_t hash = Hash64(bytes->data(), bytes->size());
+    g_hashes.Insert(dest.native(), stamp, hash); // the rename kept size and last-write time
+    if (g_cache.Enabled()) g_cache.Insert(dest.native(), stamp, bytes, hash);
+    return true;
+}
+
+// ---------- capture naming ----------
+bool ParseSlotNumber(const std::wstring& name, SlotNumber& out, const std::wstring& prefix) {
+    if (name.size() < prefix.size() ||
+        (!prefix.empty() && CompareStringOrdinal(name.c_str(), (int)prefix.size(), prefix.c_str(), (int)prefix.size(),
+                                                 TRUE) != CSTR_EQUAL)) {
+        return false;
+    }
+    size_t i = prefix.size(), n = name.size();
+
+    size_t sepStart = i;
+    while (i < n && IsSep(name[i]) && name[i] != L'.') ++i;
+    size_t digitStart = i;
+    uint64_t value = 0;
+    while (i < n && iswdigit(name[i])) { value = value * 10 + (unsigned)(name[i] - L'0'); ++i; }
+    if (i == digitStart) return false;
+
+    std::wstring ext = name.substr(i);
+    if (!ext.empty() && (ext[0] != L'.' || std::any_of(ext.begin() + 1, ext.end(), [](wchar_t c) {
+            return !iswalpha(c);
+        }))) {
+        return false; // "bf2savefile_5 boss" and the like are not part of a sequence
+    }
+    out.sep = name.substr(sepStart, digitStart - sepStart);
+    out.value = value;
+    out.digits = i - digitStart;
+    out.ext = std::move(ext);
+    return true;
+}
+
+std::wstring NextSlotName(const std::vector<SlotEntry>& files, const std::wstring& ext,
+                          const std::function<bool(const std::wstring&)>& taken, const std::wstring& prefix) {
+    // Natural order sorts by number first, so the last numbered entry holds the maximum.
+    SlotNumber last;
+    last.sep = L"_";
+    last.ext = ext;
+    bool found = false;
+    for (auto it = files.rbegin(); it != files.rend() && !found; ++it) found = ParseSlotNumber(it->name, last, prefix);
+
+    uint64_t value = found ? last.value + 1 : 1;
+    for (;; ++value) {
+        wchar_t digits[32];
+        swprintf(digits, 32, L"%0*llu", (int)std::max<size_t>(last.digits, 1), (unsigned long long)value);
+        std::wstring name = prefix + last.sep + digits + last.ext;
+        if (!taken(name)) return name;
+    }
+}
@@ -0,0 +1,676 @@
+// Non-UI core shared by the Directorizer GUI and bench: natural ordering, slot
+// enumeration, file metadata, the RAM save cache, restore strategies and latency
+// bookkeeping, config.txt storage. No windows. Process-wide state: g_cache,
+// g_hashes and g_backups, the I/O options behind SetIoOptions, OpenPack's most
+// recently opened archive and the diff engine picked at first use.
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <system_error>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// ---------- utf8 helpers ----------
+std::string ToUtf8(const std::wstring& s);
+std::wstring FromUtf8(const std::string& s);
+
+// ---------- natural compare (number-aware) ----------
+bool NaturalLess(const std::wstring& a, const std::wstring& b);
+
+// ---------- precomputed natural sort keys ----------
+// A name flattened once into units that compare lexicographically in exactly the
+// order NaturalLess gives, so sorting and inserting never re-tokenize:
+//   letter          -> towlower(c)
+//   digit run       -> kKeyNumber, value high 32 bits, value low 32 bits, run length
+//   trailing seps   -> kKeyTrailingSep (separators elsewhere vanish, as in NaturalLess)
+// kKeyNumber sits inside '0'..'9', a range no letter unit can take, so a number
+// still orders against letters the way its first digit would.
+constexpr uint32_t kKeyTrailingSep = 0;
+constexpr uint32_t kKeyNumber      = L'0';
+
+struct NaturalKey {
+    std::vector<uint32_t> units;
+    bool operator<(const NaturalKey& o) const { return units < o.units; }
+};
+
+NaturalKey MakeNaturalKey(const std::wstring& s);
+
+// Directory entry with its sort key cached alongside, plus what the content index
+// knows about it.
+struct SlotEntry {
+    std::wstring name;
+    NaturalKey key;
+    uint64_t hash = 0;
+    bool hashed = false;
+    std::wstring dupOf; // first slot (natural order) with identical contents, if any
+
+    explicit SlotEntry(std::wstring n) : name(std::move(n)), key(MakeNaturalKey(name)) {}
+    SlotEntry(std::wstring n, NaturalKey k) : name(std::move(n)), key(std::move(k)) {}
+    bool operator<(const SlotEntry& o) const { return key < o.key; }
+};
+
+// ---------- enumerate slots (default "bf2savefile*") in natural order ----------
+// Patterns are case-insensitive globs with '*' and '?'. Names starting "~dz_" (our
+// temps and backups) never match.
+constexpr const wchar_t* kDefaultPattern = L"bf2savefile*";
+bool IsSlotName(const std::wstring& name, const std::wstring& pattern = kDefaultPattern);
+
+// Returns false if cancelled() became true part-way; files is then incomplete.
+bool EnumerateSlotFiles(const std::wstring& folder, std::vector<SlotEntry>& files,
+                        const std::function<bool()>& cancelled,
+                        const std::wstring& pattern = kDefaultPattern);
+
+// ---------- slot filter (trigram index) ----------
+// Case-insensitive substring search over a listing, built off the UI thread next to
+// the enumeration. Every 1-, 2- and 3-unit gram of every name has a posting list.
+// A query of up to three characters is a single lookup. A longer one intersects the
+// lists of its trigrams, rarest first, then confirms the few candidates. Matches come
+// back as ascending indices into the listing, so they keep its natural order.
+class SlotFilter {
+public:
+    void Build(const std::vector<SlotEntry>& files);
+    size_t Size() const { return folded_.size(); }
+    void Match(const std::wstring& query, std::vector<uint32_t>& out) const;
+    // The same answer without an index, for a listing that changed since Build.
+    static void Scan(const std::vector<SlotEntry>& files, const std::wstring& query, std::vector<uint32_t>& out);
+
+private:
+    std::vector<std::wstring> folded_;                              // lowercased names
+    std::unordered_map<uint64_t, std::vector<uint32_t>> postings_; // gram -> ascending indices
+};
+
+// ---------- latency instrumentation (QueryPerformanceCounter) ----------
+enum LatencySeries {
+    kSeriesEnumerate, // directory scan + sort
+    kSeriesRead,      // source stat/open/read (or cache lookup)
+    kSeriesWrite,     // target or temp write
+    kSeriesFlush,
+    kSeriesRename,    // temp/staged swap
+    kSeriesWait,      // backing off while the target was held open (failed attempts included)
+    kSeriesVerify,    // post-restore hash check (outside the total)
+    kSeriesTotal,     // whole restore
+    kSeriesCount,
+};
+inline const char* const kSeriesNames[kSeriesCount] = {
+    "enumerate", "read", "write", "flush", "rename", "wait", "verify", "total",
+};
+
+int64_t QpcNow();
+double QpcToUs(int64_t ticks);
+
+// Per-phase ticks of one restore.
+struct RestoreTiming {
+    int64_t ticks[kSeriesCount] = {};
+};
+
+// Charges the time since the previous Mark() to the named phase.
+class PhaseClock {
+public:
+    explicit PhaseClock(RestoreTiming* timing) : timing_(timing), last_(QpcNow()) {}
+    void Mark(LatencySeries phase) {
+        int64_t now = QpcNow();
+        if (timing_) timing_->ticks[phase] += now - last_;
+        last_ = now;
+    }
+
+private:
+    RestoreTiming* timing_;
+    int64_t last_;
+};
+
+// Rolling window of the most recent samples per series; summaries and the CSV
+// histogram are computed from the window on demand.
+class LatencyStats {
+public:
+    static constexpr size_t kWindow = 4096;
+    static constexpr int kBuckets = 32; // bucket b holds [2^(b-1), 2^b) microseconds
+
+    void Record(LatencySeries series, double us) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Ring& r = rings_[series];
+        if (r.samples.size() < kWindow) r.samples.push_back(us);
+        else r.samples[r.next] = us;
+        r.next = (r.next + 1) % kWindow;
+        r.last = us;
+    }
+    void Record(const RestoreTiming& t) {
+        for (int i = kSeriesRead; i < kSeriesCount; ++i) {
+            if (t.ticks[i] || i == kSeriesTotal) Record((LatencySeries)i, QpcToUs(t.ticks[i]));
+        }
+    }
+
+    struct Summary {
+        size_t count = 0;
+        double last = 0, median = 0, p99 = 0;
+    };
+    Summary Summarize(LatencySeries series) const {
+        std::vector<double> v;
+        Summary s;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            v = rings_[series].samples;
+            s.last = rings_[series].last;
+        }
+        s.count = v.size();
+        if (v.empty()) return s;
+        s.median = Percentile(v, 0.50);
+        s.p99 = Percentile(v, 0.99);
+        return s;
+    }
+
+    // "series,lower_us,upper_us,count" rows, empty buckets skipped.
+    bool WriteCsv(std::ostream& out) const {
+        out << "series,lower_us,upper_us,count\n";
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < kSeriesCount; ++i) {
+            size_t counts[kBuckets] = {};
+            for (double us : rings_[i].samples) counts[Bucket(us)]++;
+            for (int b = 0; b < kBuckets; ++b) {
+                if (!counts[b]) continue;
+                out << kSeriesNames[i] << "," << (b ? (1ull << (b - 1)) : 0) << "," << (1ull << b) << ","
+                    << counts[b] << "\n";
+            }
+        }
+        return (bool)out;
+    }
+
+private:
+    struct Ring {
+        std::vector<double> samples;
+        size_t next = 0;
+        double last = 0;
+    };
+
+    static int Bucket(double us) {
+        int b = 0;
+        while (b < kBuckets - 1 && us >= (double)(1ull << b)) ++b;
+        return b;
+    }
+    static double Percentile(std::vector<double>& v, double q) {
+        size_t k = std::min(v.size() - 1, (size_t)(q * (double)v.size()));
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        return v[k];
+    }
+
+    mutable std::mutex mutex_;
+    Ring rings_[kSeriesCount];
+};
+
+// ---------- file metadata ----------
+struct FileStamp {
+    uint64_t size = 0;
+    uint64_t lastWrite = 0; // FILETIME ticks
+    bool operator==(const FileStamp& o) const { return size == o.size && lastWrite == o.lastWrite; }
+};
+
+std::error_code LastError();
+uint64_t ToTicks(const FILETIME& ft);
+FILETIME FromTicks(uint64_t ticks);
+
+// Regular files only; a directory or missing path fails with no_such_file_or_directory.
+bool StatFile(const std::wstring& path, FileStamp& out, std::error_code& ec);
+
+// ---------- content hash (XXH64) ----------
+// Streaming XXH64: non-cryptographic, several GB/s per core, so hashing a save is
+// far cheaper than writing it. Same output as the reference for any chunking.
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0);
+    void Update(const void* data, size_t len);
+    uint64_t Digest() const;
+
+private:
+    uint64_t v_[4];
+    uint64_t total_ = 0;
+    unsigned char buf_[32];
+    size_t buffered_ = 0;
+};
+
+uint64_t Hash64(const void* data, size_t len);
+
+// Hashes the file's current contents; stamp comes from the open handle.
+bool HashFile(const std::wstring& path, uint64_t& hash, FileStamp& stamp, std::error_code& ec);
+
+// Source hashes keyed by path, valid while size and last-write time match.
+class HashCache {
+public:
+    bool Find(const std::wstring& path, const FileStamp& stamp, uint64_t& hash) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it == entries_.end() || !(it->second.stamp == stamp)) return false;
+        hash = it->second.hash;
+        return true;
+    }
+    void Insert(const std::wstring& path, const FileStamp& stamp, uint64_t hash) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[path] = Entry{ stamp, hash };
+    }
+
+private:
+    struct Entry {
+        FileStamp stamp;
+        uint64_t hash = 0;
+    };
+    mutable std::mutex mutex_;
+    std::unordered_map<std::wstring, Entry> entries_;
+};
+
+extern HashCache g_hashes;
+
+// ---------- RAM save cache (size-bounded LRU) ----------
+// Holds recently restored slot contents keyed by path; an entry only counts as a hit
+// while the file's size and last-write time still match what was read. Paths with
+// byte-identical contents share one blob, and the budget counts it once.
+using SaveBlob = std::shared_ptr<const std::vector<char>>;
+
+class SaveCache {
+public:
+    void SetBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        budget_ = bytes;
+        EvictLocked();
+    }
+    bool Enabled() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return budget_ != 0;
+    }
+
+    SaveBlob Find(const std::wstring& path, const FileStamp& stamp) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(path);
+        if (it == index_.end()) return nullptr;
+        if (!(it->second->stamp == stamp)) { // file changed on disk
+            EraseLocked(it->second);
+            return nullptr;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->data;
+    }
+
+    // 'hash' is the XXH64 of data; returns the blob actually kept, which is an
+    // existing identical one when there is one.
+    SaveBlob Insert(const std::wstring& path, const FileStamp& stamp, SaveBlob data, uint64_t hash) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (data->size() > budget_) return data;
+        auto it = index_.find(path);
+        if (it != index_.end()) EraseLocked(it->second);
+
+        Blob& blob = blobs_[hash];
+        if (blob.refs && *blob.data == *data) {
+            data = blob.data;
+        } else if (blob.refs) {
+            return data; // hash collision: leave the resident blob alone, don't cache this one
+        } else {
+            blob.data = data;
+            used_ += data->size();
+        }
+        ++blob.refs;
+        lru_.push_front(Item{ path, stamp, hash, data });
+        index_[path] = lru_.begin();
+        EvictLocked();
+        return data;
+    }
+
+private:
+    struct Item {
+        std::wstring path;
+        FileStamp stamp;
+        uint64_t hash;
+        SaveBlob data;
+    };
+    struct Blob {
+        SaveBlob data;
+        size_t refs = 0;
+    };
+
+    void EraseLocked(std::list<Item>::iterator it) {
+        auto blob = blobs_.find(it->hash);
+        if (--blob->second.refs == 0) {
+            used_ -= blob->second.data->size();
+            blobs_.erase(blob);
+        }
+        index_.erase(it->path);
+        lru_.erase(it);
+    }
+    void EvictLocked() {
+        while (used_ > budget_ && !lru_.empty()) EraseLocked(std::prev(lru_.end()));
+    }
+
+    mutable std::mutex mutex_;
+    std::list<Item> lru_; // most recent first
+    std::unordered_map<std::wstring, std::list<Item>::iterator> index_;
+    std::unordered_map<uint64_t, Blob> blobs_; // by content hash
+    size_t budget_ = 0, used_ = 0;
+};
+
+extern SaveCache g_cache;
+
+// ---------- content index ----------
+// Persistent name -> (size, mtime, hash) map for one folder, so duplicate detection
+// only ever hashes files that changed since the last run. Not thread-safe: owned by
+// whichever worker maintains it.
+struct IndexEntry {
+    FileStamp stamp;
+    uint64_t hash = 0;
+};
+
+class SlotIndex {
+public:
+    const std::wstring& Folder() const { return folder_; }
+    const std::unordered_map<std::wstring, IndexEntry>& Entries() const { return entries_; }
+
+    // Switches to folder, reading its saved index from file if there is one.
+    void Open(const std::wstring& folder, const fs::path& file);
+    bool SaveIfDirty(std::error_code& ec);
+
+    // Re-stats name and rehashes it if its stamp moved. Returns false if the file
+    // is gone (its entry is dropped) or unreadable.
+    bool Update(const std::wstring& name, IndexEntry& out);
+    // Drops entries for names no longer in the folder.
+    void Retain(const std::vector<std::wstring>& names);
+
+private:
+    std::wstring folder_;
+    fs::path file_;
+    std::unordered_map<std::wstring, IndexEntry> entries_;
+    bool dirty_ = false;
+};
+
+// "<dir>\<hash of folder><ext>": one file per folder, stable across runs.
+fs::path IndexPathFor(const fs::path& dir, const std::wstring& folder, const wchar_t* ext = L".idx");
+
+// ---------- folder snapshot ----------
+// The last enumeration of a folder (names and sort keys, already in order) with the
+// directory's last-write time, which moves whenever an entry is added, removed or
+// renamed. A restart shows the snapshot at once and only rescans if the time moved.
+bool DirWriteTime(const std::wstring& folder, uint64_t& ticks);
+bool SaveFolderSnapshot(const fs::path& file, const std::wstring& folder, uint64_t dirWrite,
+                        const std::vector<SlotEntry>& files, std::error_code& ec);
+bool LoadFolderSnapshot(const fs::path& file, const std::wstring& folder, uint64_t& dirWrite,
+                        std::vector<SlotEntry>& files);
+
+// ---------- config store ----------
+// config.txt held in memory: top-level "key=value" lines, then "[name]" sections.
+// Read with one file read and parsed in place. Set() only marks the store dirty when
+// a value actually changes, and Save() writes through a temp file and SwapIntoPlace.
+// Lines that are not key=value (comments, blanks) and keys nobody sets are written
+// back as they were. Not thread-safe: the UI thread owns it.
+class ConfigStore {
+public:
+    struct Entry {
+        std::string key;   // "" for a line kept verbatim in value
+        std::string value;
+    };
+    struct Section {
+        std::string name;  // "" for the top level, always Sections()[0]
+        std::vector<Entry> entries;
+    };
+
+    // Replaces the contents with file's. Returns false if it could not be read; the
+    // store is then empty and ec is clear if the file simply does not exist.
+    bool Load(const fs::path& file, std::error_code& ec);
+    const std::vector<Section>& Sections() const { return sections_; }
+    const std::string* Find(std::string_view section, std::string_view key) const;
+    // Adds the section and key at the end if they are new.
+    void Set(std::string_view section, std::string_view key, std::string_view value);
+
+    bool Dirty() const { return dirty_; }
+    bool Save(std::error_code& ec); // no-op unless dirty
+    // The file's size or mtime moved since the last Load or Save: someone else wrote it.
+    bool ChangedOnDisk() const;
+
+private:
+    fs::path file_;
+    std::vector<Section> sections_{ Section{} };
+    FileStamp stamp_;
+    bool dirty_ = false;
+};
+
+// ---------- I/O options ----------
+// How restores open and finish their handles; the defaults reproduce a plain copy.
+enum class IoPriority { Normal, Low, VeryLow }; // FileIoPriorityHintInfo on source and target
+enum class FlushMode {
+    Lazy,         // leave dirty pages to the cache manager
+    Flush,        // FlushFileBuffers before the handle closes (the flush latency phase)
+    WriteThrough, // FILE_FLAG_WRITE_THROUGH: each write reaches the disk before returning
+};
+
+struct IoOptions {
+    IoPriority priority = IoPriority::Normal;
+    bool sequentialScan = true; // FILE_FLAG_SEQUENTIAL_SCAN on the source
+    FlushMode flush = FlushMode::Lazy;
+    uint32_t shareWaitMs = 1000; // how long RestoreSlot retries a target held open; 0 = fail at once
+
+    // Whether the handles are opened the default way; shareWaitMs does not matter here.
+    bool IsDefault() const { return priority == IoPriority::Normal && sequentialScan && flush == FlushMode::Lazy; }
+    DWORD SourceFlags() const { return sequentialScan ? FILE_FLAG_SEQUENTIAL_SCAN : 0; }
+    DWORD TargetFlags() const { return flush == FlushMode::WriteThrough ? FILE_FLAG_WRITE_THROUGH : 0; }
+};
+
+const char* IoPriorityName(IoPriority p);
+IoPriority ParseIoPriority(const std::string& s);
+const char* FlushModeName(FlushMode m);
+FlushMode ParseFlushMode(const std::string& s);
+
+// What RestoreSlot uses; set from the config, read once per restore.
+void SetIoOptions(const IoOptions& io);
+IoOptions CurrentIoOptions();
+
+void ApplyIoPriority(HANDLE h, IoPriority p);
+// FlushFileBuffers under FlushMode::Flush; with a clock, the write phase ends before
+// it and the flush phase after it.
+bool FinishWrites(HANDLE h, const IoOptions& io, PhaseClock* clock, std::error_code& ec);
+
+// ---------- whole-file and delta I/O ----------
+bool ReadWholeFile(const std::wstring& path, std::vector<char>& out, FileStamp& stamp, std::error_code& ec,
+                   const IoOptions& io = {});
+bool WriteWholeFile(const std::wstring& path, const char* data, size_t size, const FileStamp& stamp,
+                    std::error_code& ec, const IoOptions& io = {}, PhaseClock* clock = nullptr);
+inline bool WriteWholeFile(const std::wstring& path, const std::vector<char>& data, const FileStamp& stamp,
+                           std::error_code& ec, const IoOptions& io = {}, PhaseClock* clock = nullptr) {
+    return WriteWholeFile(path, data.data(), data.size(), stamp, ec, io, clock);
+}
+
+constexpr size_t kDeltaBlock = 4096;
+
+struct ByteRange {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+bool DeltaWriteFile(const std::wstring& path, const char* data, size_t size, const FileStamp& stamp,
+                    std::error_code& ec, const IoOptions& io = {}, PhaseClock* clock = nullptr);
+inline bool DeltaWriteFile(const std::wstring& path, const std::vector<char>& data, const FileStamp& stamp,
+                           std::error_code& ec, const IoOptions& io = {}, PhaseClock* clock = nullptr) {
+    return DeltaWriteFile(path, data.data(), data.size(), stamp, ec, io, clock);
+}
+
+// ---------- binary diff ----------
+// Byte comparison with the widest vectors the CPU has: AVX2, else SSE2, else a
+// word-at-a-time loop. Picked once per process; DeltaWriteFile uses it too.
+const char* DiffEngineName(); // "avx2", "sse2" or "scalar"
+
+// Runs of differing bytes in a and b, ascending. Runs separated by at most mergeGap
+// equal bytes are joined. If the sizes differ, the longer side's tail is one more run.
+void DiffRanges(const char* a, size_t aSize, const char* b, size_t bSize, size_t mergeGap,
+                std::vector<ByteRange>& out);
+
+constexpr size_t kDiffPreview = 16; // bytes of each side kept per range
+
+struct SlotDiff {
+    uint64_t sizeA = 0, sizeB = 0;
+    std::vector<ByteRange> ranges;
+    std::vector<std::string> hexA, hexB; // per range: first kDiffPreview bytes ("" past that side's end)
+
+    uint64_t Differing() const;
+    // "offset,length,a,b" rows, offsets in hex.
+    bool WriteCsv(std::ostream& out) const;
+};
+
+// Maps both slots read-only (a .dzpack entry is used from its archive) and diffs
+// them. Slot groups are refused.
+bool DiffSlots(const fs::path& a, const fs::path& b, size_t mergeGap, SlotDiff& out, std::error_code& ec);
+
+// ---------- slot archive (.dzpack) ----------
+// All slots of a folder in one file, memory-mapped for reading:
+//   "DZPACK1\0", u32 entry count, u32 reserved,
+//   per entry: u64 offset, u64 stored size, u64 size, u64 XXH64 of the contents,
+//              u32 codec, u16 name length, UTF-16 name
+//   then the blobs. A "folder" path ending in .dzpack selects the archive; its slots
+// restore to the target in the folder that contains it.
+enum : uint32_t {
+    kPackStored = 0,
+    kPackXpressHuff = 1, // COMPRESS_ALGORITHM_XPRESS_HUFF (Cabinet.dll)
+};
+
+struct PackEntry {
+    std::wstring name;
+    uint64_t offset = 0, stored = 0, size = 0, hash = 0;
+    uint32_t codec = kPackStored;
+};
+
+class PackFile {
+public:
+    PackFile() = default;
+    ~PackFile();
+    PackFile(const PackFile&) = delete;
+    PackFile& operator=(const PackFile&) = delete;
+
+    bool Open(const std::wstring& path, std::error_code& ec);
+    const std::vector<PackEntry>& Entries() const { return entries_; }
+    const PackEntry* Find(const std::wstring& name) const;
+    const FileStamp& Stamp() const { return stamp_; }
+
+    // The entry's contents: straight from the mapping when stored, else decompressed
+    // into scratch. 'out' stays valid while this PackFile and scratch live.
+    bool Contents(const PackEntry& e, const char*& out, std::vector<char>& scratch, std::error_code& ec) const;
+
+private:
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE map_ = nullptr;
+    const char* view_ = nullptr;
+    FileStamp stamp_;
+    std::vector<PackEntry> entries_;
+    std::unordered_map<std::wstring, size_t> byName_;
+};
+
+bool IsPackPath(std::wstring_view folder);
+// Folder holding the target: the archive's own folder for a .dzpack, else folder.
+fs::path SlotDir(const std::wstring& folder);
+// "<x>.dzpack\<name>" -> (x.dzpack, name).
+bool SplitPackPath(const fs::path& src, std::wstring& pack, std::wstring& name);
+// The open archive for path, shared until the file's size or mtime changes.
+std::shared_ptr<const PackFile> OpenPack(const std::wstring& path, std::error_code& ec);
+// Packs every slot of folder into out (via a temp file); 'compress' keeps an XPRESS
+// blob wherever it is smaller than the original.
+bool WritePack(const std::wstring& folder, const std::wstring& out, bool compress, size_t& count,
+               std::error_code& ec, const std::wstring& pattern = kDefaultPattern);
+
+// ---------- restore ----------
+enum class RestoreMode {
+    Copy,   // fs::copy_file, or a whole rewrite from the RAM cache when enabled
+    CopyEx, // CopyFileExW (kernel-side copy), or a whole rewrite from the RAM cache
+    Delta,  // rewrite only the blocks that differ from the current target
+    Atomic, // write a temp file beside the target, then rename it over the target
+};
+
+const char* RestoreModeName(RestoreMode m);
+RestoreMode ParseRestoreMode(const std::string& s);
+
+fs::path TempPathFor(const fs::path& dest, const wchar_t* tag);
+// temp is deleted if the rename fails, unless keepTemp (the caller will try again).
+bool SwapIntoPlace(const fs::path& temp, const fs::path& dest, std::error_code& ec, bool keepTemp = false);
+
+// ---------- backup ring ----------
+// The last Depth() targets from before each restore, as "<target>.<n>" in a
+// ~dz_backups folder beside the target. An atomic swap moves the old target into
+// the ring as part of its ReplaceFileW, which writes no data. Every in-place writer
+// (copy, copyex, whole-file, delta) leaves the target where it is and block-clones
+// it into the ring on ReFS, or copies it on other file systems.
+class BackupRing {
+public:
+    void SetDepth(size_t n) { depth_ = n; }
+    size_t Depth() const { return depth_; }
+    static fs::path Dir(const fs::path& dest) { return dest.parent_path() / L"~dz_backups"; }
+
+    // Before dest is written in place: a block clone, or a copy where the volume has
+    // none. dest itself stays put, so a failed write never leaves it missing. No-op at
+    // depth 0 or with no target yet.
+    bool Take(const fs::path& dest, std::error_code& ec);
+    // SwapIntoPlace that keeps the replaced target in the ring (ReplaceFileW).
+    bool Swap(const fs::path& temp, const fs::path& dest, std::error_code& ec, bool keepTemp = false);
+    // Renames the newest backup back over dest. False with ec clear if there is none.
+    bool Undo(const fs::path& dest, std::error_code& ec);
+    // An old target already renamed aside (by a group commit) joins the ring, or is
+    // deleted at depth 0.
+    void Adopt(const fs::path& old, const fs::path& dest);
+
+private:
+    fs::path NextLocked(const fs::path& dest, std::error_code& ec);
+    void TrimLocked(const fs::path& dest);
+
+    std::atomic<size_t> depth_{ 0 };
+    std::mutex mutex_;
+};
+extern BackupRing g_backups;
+
+// ---------- slot groups ----------
+// A slot that is a folder ("bf2savefile_3\") holds the save and its companions
+// (settings saves, emulator metadata); each file restores to the file of the same
+// name beside the target. All of them are copied at once with overlapped I/O into
+// temps, and only then renamed over their targets, so they switch together.
+bool IsSlotGroup(const fs::path& src);
+// The group's file names, in natural order.
+std::vector<std::wstring> GroupFiles(const fs::path& src);
+bool LoadSlot(const std::wstring& src, SaveBlob& data, FileStamp& stamp, std::error_code& ec,
+              const IoOptions& io = {});
+// Reads src ahead of a restore (each member, for a group): into the RAM cache when it
+// is enabled, otherwise through the OS file cache with very-low-priority I/O and the
+// bytes thrown away. Returns false with ec clear if cancelled() turned true first.
+bool PrefetchSlot(const fs::path& src, const std::function<bool()>& cancelled, std::error_code& ec);
+// A restore that fails because the game or emulator has the slot or the target open
+// is retried with exponential backoff (1 ms doubling to 64 ms) for up to
+// IoOptions::shareWaitMs. Failed attempts and sleeps are charged to kSeriesWait. The
+// retries reuse the first attempt's backup and, for atomic, its written temp.
+void RestoreSlot(const fs::path& src, const fs::path& dest, RestoreMode mode, std::error_code& ec,
+                 RestoreTiming* timing = nullptr);
+// Sharing or lock violation, or the access denied of replacing a file someone holds
+// open without FILE_SHARE_DELETE (dest exists and is not read-only).
+bool IsTargetBusy(const std::error_code& ec, const fs::path& dest);
+
+// Copies src (the target) to the new slot dest without ever replacing an existing
+// file, and caches the bytes under dest so restoring the capture needs no read.
+bool CaptureFile(const fs::path& src, const fs::path& dest, std::error_code& ec);
+
+// ---------- capture naming ----------
+// prefix + separators + digit run + optional extension, e.g. "bf2savefile_007.sav".
+struct SlotNumber {
+    std::wstring sep;    // between prefix and number
+    uint64_t value = 0;
+    size_t digits = 0;   // run length, kept as the minimum width of the next number
+    std::wstring ext;    // "" or ".xyz"
+};
+bool ParseSlotNumber(const std::wstring& name, SlotNumber& out, const std::wstring& prefix = L"bf2savefile");
+
+// Name for the slot after the highest-numbered one in files (natural order), in the
+// same style; "<prefix>_1<ext>" if nothing is numbered. Skips names taken() reports.
+std::wstring NextSlotName(const std::vector<SlotEntry>& files, const std::wstring& ext,
+                          const std::function<bool(const std::wstring&)>& taken,
+                          const std::wstring& prefix = L"bf2savefile");
+
+// Hashes dest and compares it with src's (cached) hash. Returns false with ec set
+// if either could not be read; otherwise 'matched' says whether they agree.
+bool VerifyRestore(const fs::path& src, const fs::path& dest, bool& matched, std::error_code& ec);
@@ -1,32 +1,55 @@
 #include <windows.h>
 #include <shobjidl.h>   // IFileDialog
+#include <shellapi.h>   // CommandLineToArgvW
 #include <commctrl.h>
+#include <winmeta.h>    // WINEVENT_LEVEL_*
+#include <TraceLoggingProvider.h>
 #include <string>
 #include <vector>
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
-#include <cwctype>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 
+#include "core.h"
 #include "resource.h"
 
-namespace fs = std::filesystem;
+// ---------- private messages / timers ----------
+constexpr UINT WM_APP_SCAN_DONE   = WM_APP + 1;  // lParam: ScanResult* (receiver owns)
+constexpr UINT WM_APP_DIR_CHANGED = WM_APP + 2;  // lParam: DirChangeBatch* (receiver owns)
+constexpr UINT WM_APP_RESTORE_DONE = WM_APP + 3; // wParam: 1 = success, 0 = failed, 2 = verify mismatch,
+                                                  // 3 = target still in use; lParam: ms spent waiting on it
+constexpr UINT WM_APP_PIPE_COMMAND = WM_APP + 4; // lParam: std::shared_ptr<PipeCommand>* (receiver owns)
+constexpr UINT WM_APP_INDEX_DONE   = WM_APP + 5; // lParam: IndexResult* (receiver owns)
+constexpr UINT WM_APP_CAPTURE_DONE = WM_APP + 6; // lParam: CaptureResult* (receiver owns)
+constexpr UINT WM_APP_UNDO_DONE    = WM_APP + 7; // wParam: 1 = restored, 0 = failed, 2 = no backup left
+constexpr UINT WM_APP_FILTER_READY = WM_APP + 8; // lParam: FilterBuild* (receiver owns)
+constexpr UINT WM_APP_CONFIG_CHANGED = WM_APP + 9; // the exe folder watcher saw config.txt change
+constexpr UINT WM_APP_DIFF_DONE    = WM_APP + 10; // lParam: DiffResult* (receiver owns)
 
-// ---------- utf8 helpers + exe dir ----------
-static std::string ToUtf8(const std::wstring& s) {
-    if (s.empty()) return {};
-    int len = WideCharToMultiByte(CP_UTF8, 0, s.c_str(), -1, nullptr, 0, nullptr, nullptr);
-    std::string out(len ? len - 1 : 0, '\0');
-    if (len > 1) WideCharToMultiByte(CP_UTF8, 0, s.c_str(), -1, out.data(), len, nullptr, nullptr);
-    return out;
-}
-static std::wstring FromUtf8(const std::string& s) {
-    if (s.empty()) return {};
-    int len = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, nullptr, 0);
-    std::wstring out(len ? len - 1 : 0, L'\0');
-    if (len > 1) MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, out.data(), len);
-    return out;
-}
+constexpr UINT_PTR kStatusTimer = 1;
+constexpr UINT_PTR kScanTimer   = 2;
+constexpr UINT kScanDebounceMs  = 150;
+constexpr UINT_PTR kConfigTimer = 3; // dirty config.txt is written when this fires
+constexpr UINT kConfigSaveMs    = 2000;
+constexpr UINT_PTR kConfigReloadTimer = 4; // external edits settle before the reload
+constexpr UINT kConfigReloadMs  = 250;
+constexpr int kConfigReloadRetries = 8; // a file still locked after ~2 s waits for its next write
+
+// ---------- exe dir ----------
 static fs::path GetExeDir() {
     wchar_t buf[MAX_PATH]{};
     GetModuleFileNameW(nullptr, buf, MAX_PATH);
@@ -38,72 +61,762 @@ static void SetText(HWND hDlg, int ctrlId, const std::wstring& s) {
     SetWindowTextW(GetDlgItem(hDlg, ctrlId), s.c_str());
 }
 static std::wstring GetText(HWND hDlg, int ctrlId) {
-    wchar_t buf[4096]{};
-    GetWindowTextW(GetDlgItem(hDlg, ctrlId), buf, 4096);
-    return std::wstring(buf);
+    HWND h = GetDlgItem(hDlg, ctrlId);
+    std::wstring s((size_t)GetWindowTextLengthW(h) + 1, L'\0');
+    s.resize((size_t)GetWindowTextW(h, s.data(), (int)s.size()));
+    return s;
 }
 
-// ---------- natural compare (number-aware) ----------
-static bool IsSep(wchar_t c) {
-    return c == L' ' || c == L'_' || c == L'-' || c == L'.';
+// ---------- background worker ----------
+// One thread running jobs in FIFO order. A job submitted with a non-zero coalesce key
+// replaces any queued (not yet started) job with the same key, so bursts of requests
+// collapse into the latest one.
+enum : int {
+    kCoalesceNone = 0,
+    kCoalesceScan,
+    kCoalesceRestore,
+    kCoalesceStage,
+    kCoalesceIndex,
+    kCoalesceFilter,
+    kCoalescePrefetch,
+};
+
+class JobWorker {
+public:
+    JobWorker() : thread_([this] { Run(); }) {}
+    ~JobWorker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+    JobWorker(const JobWorker&) = delete;
+    JobWorker& operator=(const JobWorker&) = delete;
+
+    void Submit(std::function<void()> job, int coalesceKey = kCoalesceNone) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (coalesceKey != kCoalesceNone) {
+                queue_.erase(std::remove_if(queue_.begin(), queue_.end(),
+                                            [coalesceKey](const Job& j) { return j.key == coalesceKey; }),
+                             queue_.end());
+            }
+            queue_.push_back(Job{ coalesceKey, std::move(job) });
+        }
+        cv_.notify_one();
+    }
+
+private:
+    struct Job {
+        int key;
+        std::function<void()> run;
+    };
+
+    void Run() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (stop_) return; // queued jobs are dropped; the running one always finishes
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            job.run();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> queue_;
+    bool stop_ = false;
+    std::thread thread_; // last: starts after the members above exist
+};
+
+// ---------- folder watcher (overlapped ReadDirectoryChangesW) ----------
+struct DirChange {
+    DWORD action = 0; // FILE_ACTION_*
+    std::wstring name;
+};
+
+// Watches one folder (non-recursive) for file create/delete/rename/write on its own thread.
+// Subfolder names are watched too: a slot group is a folder, and EnumerateSlotFiles
+// lists files and folders alike, so changes name an entry of either kind.
+// onChanges gets each notification batch; overflow=true means events were lost and
+// the caller should rescan. The thread is detached on destruction, so a watcher
+// stuck opening an unreachable share never blocks the UI thread.
+class DirWatcher {
+public:
+    using Callback = std::function<void(std::vector<DirChange>&& changes, bool overflow)>;
+
+    DirWatcher(std::wstring folder, Callback onChanges)
+        : stop_(std::make_shared<StopEvent>()) {
+        std::thread(Run, std::move(folder), std::move(onChanges), stop_).detach();
+    }
+    ~DirWatcher() { SetEvent(stop_->handle); }
+    DirWatcher(const DirWatcher&) = delete;
+    DirWatcher& operator=(const DirWatcher&) = delete;
+
+private:
+    struct StopEvent {
+        HANDLE handle = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        ~StopEvent() { CloseHandle(handle); }
+    };
+
+    static void Run(std::wstring folder, Callback onChanges, std::shared_ptr<StopEvent> stop) {
+        HANDLE dir = CreateFileW(folder.c_str(), FILE_LIST_DIRECTORY,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                 OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (dir == INVALID_HANDLE_VALUE) return;
+
+        OVERLAPPED ov{};
+        ov.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        std::vector<DWORD> buffer(16 * 1024); // 64 KB: the most a network share will return
+
+        for (;;) {
+            ResetEvent(ov.hEvent);
+            if (!ReadDirectoryChangesW(dir, buffer.data(), (DWORD)(buffer.size() * sizeof(DWORD)), FALSE,
+                                       FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+                                       FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+                                       nullptr, &ov, nullptr)) {
+                break;
+            }
+
+            HANDLE waits[2] = { stop->handle, ov.hEvent };
+            DWORD bytes = 0;
+            if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+                CancelIo(dir);
+                GetOverlappedResult(dir, &ov, &bytes, TRUE);
+                break;
+            }
+            if (!GetOverlappedResult(dir, &ov, &bytes, FALSE)) {
+                if (GetLastError() != ERROR_NOTIFY_ENUM_DIR) break;
+                bytes = 0;
+            }
+            if (WaitForSingleObject(stop->handle, 0) == WAIT_OBJECT_0) break;
+
+            std::vector<DirChange> changes;
+            if (bytes != 0) {
+                const BYTE* p = (const BYTE*)buffer.data();
+                for (;;) {
+                    auto* info = (const FILE_NOTIFY_INFORMATION*)p;
+                    changes.push_back({ info->Action,
+                                        std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)) });
+                    if (info->NextEntryOffset == 0) break;
+                    p += info->NextEntryOffset;
+                }
+            }
+            onChanges(std::move(changes), bytes == 0); // 0 bytes: buffer overflowed
+        }
+
+        CloseHandle(ov.hEvent);
+        CloseHandle(dir);
+    }
+
+    std::shared_ptr<StopEvent> stop_;
+};
+
+// ---------- named pipe server (line protocol, overlapped I/O) ----------
+// Serves one client at a time on its own thread. Each '\n'-terminated request line is
+// passed to the handler and its reply written back followed by '\n'. The handler runs
+// on the pipe thread and gets the stop event so it can give up waiting on shutdown.
+class PipeServer {
+public:
+    using Handler = std::function<std::string(const std::string& line, HANDLE stop)>;
+
+    PipeServer(std::wstring name, Handler handler)
+        : name_(std::move(name)), handler_(std::move(handler)),
+          stop_(CreateEventW(nullptr, TRUE, FALSE, nullptr)),
+          thread_([this] { Run(); }) {}
+    ~PipeServer() {
+        SetEvent(stop_);
+        thread_.join();
+        CloseHandle(stop_);
+    }
+    PipeServer(const PipeServer&) = delete;
+    PipeServer& operator=(const PipeServer&) = delete;
+
+private:
+    // Waits for a pending overlapped op; false on stop (the op is cancelled) or failure.
+    bool Complete(HANDLE pipe, OVERLAPPED& ov, BOOL started, DWORD& bytes) {
+        if (!started && GetLastError() != ERROR_IO_PENDING) return GetLastError() == ERROR_PIPE_CONNECTED;
+        HANDLE waits[2] = { stop_, ov.hEvent };
+        if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+            CancelIo(pipe);
+            GetOverlappedResult(pipe, &ov, &bytes, TRUE);
+            return false;
+        }
+        return GetOverlappedResult(pipe, &ov, &bytes, FALSE) != 0;
+    }
+
+    void Serve(HANDLE pipe, OVERLAPPED& ov) {
+        std::string pending;
+        char buf[4096];
+        for (;;) {
+            DWORD got = 0;
+            ResetEvent(ov.hEvent);
+            if (!Complete(pipe, ov, ReadFile(pipe, buf, sizeof(buf), nullptr, &ov), got) || got == 0) return;
+            pending.append(buf, got);
+
+            size_t nl;
+            while ((nl = pending.find('\n')) != std::string::npos) {
+                std::string line = pending.substr(0, nl);
+                pending.erase(0, nl + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+
+                std::string reply = handler_(line, stop_) + "\n";
+                DWORD put = 0;
+                ResetEvent(ov.hEvent);
+                if (!Complete(pipe, ov, WriteFile(pipe, reply.data(), (DWORD)reply.size(), nullptr, &ov), put)) return;
+            }
+        }
+    }
+
+    void Run() {
+        OVERLAPPED ov{};
+        ov.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        while (WaitForSingleObject(stop_, 0) != WAIT_OBJECT_0) {
+            HANDLE pipe = CreateNamedPipeW(name_.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                           PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                           1, 64 * 1024, 4096, 0, nullptr);
+            if (pipe == INVALID_HANDLE_VALUE) break; // another instance owns the name
+
+            DWORD unused = 0;
+            ResetEvent(ov.hEvent);
+            if (Complete(pipe, ov, ConnectNamedPipe(pipe, &ov), unused)) Serve(pipe, ov);
+            DisconnectNamedPipe(pipe);
+            CloseHandle(pipe);
+        }
+        CloseHandle(ov.hEvent);
+    }
+
+    std::wstring name_;
+    Handler handler_;
+    HANDLE stop_;
+    std::thread thread_; // last: starts after the members above exist
+};
+
+static LatencyStats g_latency;
+
+// ---------- ETW tracing ----------
+// TraceLogging provider "Directorizer" (GUID derived from the name, so "*Directorizer"
+// works in WPR/PerfView). Registered for the life of the process; each event costs
+// one enabled check unless a session is listening.
+TRACELOGGING_DEFINE_PROVIDER(g_trace, "Directorizer",
+    (0x4f0a330f, 0x8ad3, 0x522b, 0x5c, 0xc2, 0x78, 0xe2, 0x75, 0x72, 0x3b, 0x12));
+
+static bool TraceEnabled() {
+    return TraceLoggingProviderEnabled(g_trace, WINEVENT_LEVEL_INFO, 0);
 }
-static bool NaturalLess(const std::wstring& a, const std::wstring& b) {
-    size_t i = 0, j = 0, na = a.size(), nb = b.size();
-    while (i < na && j < nb) {
-        while (i < na && IsSep(a[i])) ++i;
-        while (j < nb && IsSep(b[j])) ++j;
-        if (i >= na || j >= nb) break;
 
-        bool ad = iswdigit(a[i]) != 0;
-        bool bd = iswdigit(b[j]) != 0;
+// ---------- profiles ----------
+// One game or emulator: which names in its folder are slots and the file they restore
+// over. The top-level keys of config.txt are profile 0; each "[profile Name]" section
+// adds another. Profiles are fixed once the config is read, so an index stays valid.
+struct Profile {
+    std::wstring name = L"Default";
+    std::string section;       // in config.txt: "" for the top level, else "profile <name>"
+    std::wstring folder, file; // last folder and selection
+    std::wstring pattern = kDefaultPattern;
+    std::wstring target = L"bf2savefile.sav";
+};
+
+static std::vector<Profile> g_profiles{ Profile{} };
+static size_t g_activeProfile = 0; // picked in IDC_COMBO_PROFILE; may not be listed yet
+
+// Start of the pattern up to its first wildcard, else the target's stem: new
+// captures are named "<prefix>_<n>".
+static std::wstring CapturePrefix(const Profile& p) {
+    std::wstring prefix = p.pattern.substr(0, p.pattern.find_first_of(L"*?"));
+    return prefix.empty() ? fs::path(p.target).stem().native() : prefix;
+}
+
+static int FindProfile(const std::wstring& name) {
+    for (size_t i = 0; i < g_profiles.size(); ++i) {
+        if (CompareStringOrdinal(g_profiles[i].name.c_str(), -1, name.c_str(), -1, TRUE) == CSTR_EQUAL) return (int)i;
+    }
+    return -1;
+}
+
+// ---------- slot list state (UI thread only, except g_scanGeneration) ----------
+struct ScanResult {
+    uint64_t generation = 0;
+    size_t profile = 0;
+    std::wstring folder;
+    std::vector<SlotEntry> files;
+    SlotFilter filter;        // built beside the listing, off the UI thread
+    bool provisional = false; // from a stale snapshot; the real scan follows
+};
+
+struct DirChangeBatch {
+    uint64_t generation = 0;
+    bool overflow = false;
+    std::vector<DirChange> changes;
+};
+
+struct SlotList {
+    uint64_t generation = 0;         // scan that produced the entries below
+    size_t profile = 0;              // whose pattern and target the entries below follow
+    std::wstring folder;             // folder the entries below came from
+    std::vector<SlotEntry> files;    // natural order; the rows of IDC_COMBO_FILES unless filtered
+    SlotFilter filter;               // over files, unless filterStale
+    bool filterStale = false;        // the watcher changed files since; a rebuild is queued
+    uint64_t filterVersion = 0;      // bumped whenever files changes
+    bool provisional = false;        // snapshot shown while its folder is rescanned
+};
+
+static SlotList g_list;
+static std::wstring g_pendingFile;  // selection to apply once the next scan lands
+static std::vector<DirChange> g_pendingChanges; // watcher events that beat their scan
+static std::atomic<uint64_t> g_scanGeneration{ 0 }; // bumped on every path change
+static std::unique_ptr<JobWorker> g_scanWorker;
+static std::unique_ptr<DirWatcher> g_watcher;
+
+static const Profile& ListedProfile() { return g_profiles[g_list.profile]; }
+
+// The watcher is armed before the scan starts so nothing created in between is
+// missed; its events are tagged with the scan generation they belong to. Every
+// profile's scans share g_scanWorker, so switching profiles cancels the old one.
+static void RequestScan(HWND hDlg, const std::wstring& folder, size_t profile) {
+    const uint64_t gen = ++g_scanGeneration;
+    const std::wstring pattern = g_profiles[profile].pattern;
 
-        if (ad && bd) {
-            unsigned long long va = 0, vb = 0;
-            size_t ia = i, jb = j;
-            while (ia < na && iswdigit(a[ia])) { va = va*10 + (unsigned)(a[ia]-L'0'); ++ia; }
-            while (jb < nb && iswdigit(b[jb])) { vb = vb*10 + (unsigned)(b[jb]-L'0'); ++jb; }
-            if (va != vb) return va < vb;
-            size_t lena = ia - i, lenb = jb - j;
-            if (lena != lenb) return lena < lenb;
-            i = ia; j = jb;
-            continue;
+    g_pendingChanges.clear();
+    g_watcher.reset();
+    if (!folder.empty()) {
+        g_watcher = std::make_unique<DirWatcher>(folder, [hDlg, gen](std::vector<DirChange>&& changes, bool overflow) {
+            auto batch = std::make_unique<DirChangeBatch>();
+            batch->generation = gen;
+            batch->overflow = overflow;
+            batch->changes = std::move(changes);
+            TraceLoggingWrite(g_trace, "DirChange", TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+                              TraceLoggingUInt32((UINT32)batch->changes.size(), "Count"),
+                              TraceLoggingBool(overflow, "Overflow"));
+            if (PostMessageW(hDlg, WM_APP_DIR_CHANGED, 0, (LPARAM)batch.get())) batch.release();
+        });
+    }
+
+    g_scanWorker->Submit([hDlg, folder, gen, profile, pattern] {
+        // The snapshot goes up first; it is the final answer if no entry changed since.
+        // It holds only the names the pattern kept, so other patterns get their own.
+        const fs::path snapFile = IndexPathFor(GetExeDir() / L"index",
+                                               pattern == kDefaultPattern ? folder : folder + L"|" + pattern, L".snap");
+        uint64_t dirWrite = 0, snapWrite = 0;
+        const bool haveDir = DirWriteTime(folder, dirWrite);
+        if (haveDir) {
+            auto snap = std::make_unique<ScanResult>();
+            if (LoadFolderSnapshot(snapFile, folder, snapWrite, snap->files)) {
+                const bool current = snapWrite == dirWrite;
+                snap->generation = gen;
+                snap->profile = profile;
+                snap->folder = folder;
+                snap->provisional = !current;
+                snap->filter.Build(snap->files);
+                if (PostMessageW(hDlg, WM_APP_SCAN_DONE, 0, (LPARAM)snap.get())) snap.release();
+                if (current) return;
+            }
         }
 
-        wchar_t ca = towlower(a[i]);
-        wchar_t cb = towlower(b[j]);
-        if (ca != cb) return ca < cb;
-        ++i; ++j;
+        auto result = std::make_unique<ScanResult>();
+        result->generation = gen;
+        result->profile = profile;
+        result->folder = folder;
+        int64_t start = QpcNow();
+        bool done = EnumerateSlotFiles(folder, result->files,
+                                       [gen] { return g_scanGeneration.load() != gen; }, pattern);
+        if (!done) return;
+        const double us = QpcToUs(QpcNow() - start);
+        g_latency.Record(kSeriesEnumerate, us);
+        TraceLoggingWrite(g_trace, "Enumerate", TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+                          TraceLoggingWideString(folder.c_str(), "Folder"),
+                          TraceLoggingUInt32((UINT32)result->files.size(), "Count"),
+                          TraceLoggingFloat64(us / 1000.0, "DurationMs"));
+        std::error_code ec;
+        if (haveDir) SaveFolderSnapshot(snapFile, folder, dirWrite, result->files, ec); // time taken before the scan
+        result->filter.Build(result->files);
+        if (PostMessageW(hDlg, WM_APP_SCAN_DONE, 0, (LPARAM)result.get())) result.release();
+    }, kCoalesceScan);
+}
+
+// The natural order treats "a_1" and "a1" as equal, so look for the exact name within
+// the run of equivalent entries starting at the lower bound.
+static std::vector<SlotEntry>::iterator FindSlot(const SlotEntry& slot, bool& found) {
+    auto it = std::lower_bound(g_list.files.begin(), g_list.files.end(), slot);
+    for (auto eq = it; eq != g_list.files.end() && !(slot < *eq); ++eq) {
+        if (eq->name == slot.name) { found = true; return eq; }
+    }
+    found = false;
+    return it;
+}
+static int FindSlotIndex(const std::wstring& name) {
+    if (name.empty()) return -1;
+    bool found = false;
+    auto it = FindSlot(SlotEntry(name), found);
+    return found ? (int)(it - g_list.files.begin()) : -1;
+}
+
+// ---------- filter view ----------
+// While the filter box has text the rows are g_view, ascending indices into
+// g_list.files; otherwise row and file index are the same. Everything outside the
+// view code works in file indices.
+static std::wstring g_filterText;
+static std::vector<uint32_t> g_view;
+static bool g_settingFilter = false; // our own SetText on IDC_EDIT_FILTER, not the user typing
+
+static bool Filtered() { return !g_filterText.empty(); }
+static int RowCount() { return Filtered() ? (int)g_view.size() : (int)g_list.files.size(); }
+static int RowToFile(int row) {
+    if (row < 0 || row >= RowCount()) return -1;
+    return Filtered() ? (int)g_view[row] : row;
+}
+// -1 if the file is filtered out.
+static int FileToRow(int file) {
+    if (!Filtered() || file < 0) return file;
+    auto it = std::lower_bound(g_view.begin(), g_view.end(), (uint32_t)file);
+    return it != g_view.end() && *it == (uint32_t)file ? (int)(it - g_view.begin()) : -1;
+}
+
+static void RefilterView() {
+    g_view.clear();
+    if (!Filtered()) return;
+    if (g_list.filterStale) SlotFilter::Scan(g_list.files, g_filterText, g_view); // until the rebuild lands
+    else                    g_list.filter.Match(g_filterText, g_view);
+}
+
+// After watcher changes the index no longer lines up with g_list.files; it is rebuilt
+// from a copy on the scan worker rather than on a keystroke.
+struct FilterBuild {
+    uint64_t version = 0;
+    SlotFilter filter;
+};
+
+static void RequestFilterBuild(HWND hDlg) {
+    g_list.filterStale = true;
+    const uint64_t version = ++g_list.filterVersion;
+    auto files = std::make_shared<const std::vector<SlotEntry>>(g_list.files);
+    g_scanWorker->Submit([hDlg, version, files] {
+        auto build = std::make_unique<FilterBuild>();
+        build->version = version;
+        build->filter.Build(*files);
+        if (PostMessageW(hDlg, WM_APP_FILTER_READY, 0, (LPARAM)build.get())) build.release();
+    }, kCoalesceFilter);
+}
+
+// ---------- slot views: dropdown, or owner-data list for huge folders ----------
+// Only the visible view holds anything; the hidden one is left empty.
+static bool g_listView = false; // IDC_LIST_FILES instead of IDC_COMBO_FILES
+
+static void OnSelectionChanged(HWND hDlg);
+static void PopulateRows(HWND hDlg);
+
+// File index of the selected row, or -1.
+static int SelectedIndex(HWND hDlg) {
+    int row = g_listView
+        ? (int)SendMessageW(GetDlgItem(hDlg, IDC_LIST_FILES), LVM_GETNEXTITEM, (WPARAM)-1, LVNI_SELECTED)
+        : (int)SendMessageW(GetDlgItem(hDlg, IDC_COMBO_FILES), CB_GETCURSEL, 0, 0);
+    return RowToFile(row);
+}
+// Selecting a slot the filter hides (a pipe SELECT, a slot hotkey) clears the filter.
+static void SelectIndex(HWND hDlg, int idx) {
+    int row = FileToRow(idx);
+    if (idx >= 0 && row < 0) {
+        g_filterText.clear();
+        g_view.clear();
+        g_settingFilter = true;
+        SetText(hDlg, IDC_EDIT_FILTER, L"");
+        g_settingFilter = false;
+        PopulateRows(hDlg);
+        row = idx;
+    }
+    if (!g_listView) {
+        SendMessageW(GetDlgItem(hDlg, IDC_COMBO_FILES), CB_SETCURSEL, row, 0);
+    } else {
+        HWND hList = GetDlgItem(hDlg, IDC_LIST_FILES);
+        ListView_SetItemState(hList, -1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+        if (row >= 0) {
+            ListView_SetItemState(hList, row, LVIS_SELECTED | LVIS_FOCUSED, LVIS_SELECTED | LVIS_FOCUSED);
+            SendMessageW(hList, LVM_ENSUREVISIBLE, row, FALSE);
+        }
     }
-    return (na - i) < (nb - j);
+    OnSelectionChanged(hDlg);
+}
+
+// ---------- populate files into combo (the profile's pattern, natural order) ----------
+// Row text: the name, plus the slot it duplicates when the content index found one.
+static std::wstring SlotLabel(const SlotEntry& f) {
+    return f.dupOf.empty() ? f.name : f.name + L"  (same as " + f.dupOf + L")";
 }
 
-// ---------- populate files into combo (only "bf2savefile*", natural order) ----------
-static void PopulateFileDropdown(HWND hCombo, const std::wstring& folder) {
+static void PopulateFileDropdown(HWND hCombo) {
+    SendMessageW(hCombo, WM_SETREDRAW, FALSE, 0);
     SendMessageW(hCombo, CB_RESETCONTENT, 0, 0);
 
-    std::error_code ec;
-    if (!fs::exists(folder, ec) || !fs::is_directory(folder, ec)) return;
+    const int rows = RowCount();
+    for (int row = 0; row < rows; ++row) {
+        SendMessageW(hCombo, CB_ADDSTRING, 0, (LPARAM)SlotLabel(g_list.files[RowToFile(row)]).c_str());
+    }
+    SendMessageW(hCombo, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(hCombo, nullptr, TRUE);
+}
+
+// Owner-data list: one message regardless of size, rows come from LVN_GETDISPINFO.
+static void PopulateFileList(HWND hList, size_t count, DWORD flags = 0) {
+    SendMessageW(hList, LVM_SETITEMCOUNT, count, flags);
+}
+
+// Fills whichever view is active with the current rows.
+static void PopulateRows(HWND hDlg) {
+    const int64_t start = TraceEnabled() ? QpcNow() : 0;
+    if (g_listView) PopulateFileList(GetDlgItem(hDlg, IDC_LIST_FILES), RowCount());
+    else            PopulateFileDropdown(GetDlgItem(hDlg, IDC_COMBO_FILES));
+    if (start) {
+        TraceLoggingWrite(g_trace, "Populate", TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+                          TraceLoggingString(g_listView ? "list" : "dropdown", "View"),
+                          TraceLoggingUInt32((UINT32)RowCount(), "Count"),
+                          TraceLoggingFloat64(QpcToUs(QpcNow() - start) / 1000.0, "DurationMs"));
+    }
+}
+
+// Fills the active view and selects 'select', else the first row.
+static void ShowSlots(HWND hDlg, const std::wstring& select) {
+    PopulateRows(hDlg);
+    int idx = FindSlotIndex(select);
+    if (FileToRow(idx) < 0) idx = RowToFile(0);
+    SelectIndex(hDlg, idx);
+}
+
+// EN_CHANGE on the filter box: refilter and show the matches, keeping the selection
+// if it still matches.
+static void OnFilterChanged(HWND hDlg) {
+    if (g_settingFilter) return;
+    const int sel = SelectedIndex(hDlg);
+    const std::wstring select = sel >= 0 ? g_list.files[sel].name : std::wstring();
+    g_filterText = GetText(hDlg, IDC_EDIT_FILTER);
+    RefilterView();
+    ShowSlots(hDlg, select);
+    if (Filtered()) {
+        SetText(hDlg, IDC_STATUS, std::to_wstring(g_view.size()) + L" of " + std::to_wstring(g_list.files.size()));
+        SetTimer(hDlg, kStatusTimer, 2500, nullptr);
+    }
+}
 
-    std::vector<std::wstring> files;
-    for (auto const& entry : fs::directory_iterator(folder, fs::directory_options::skip_permission_denied, ec)) {
-        if (ec) break;
-        if (entry.is_regular_file(ec)) {
-            std::wstring name = entry.path().filename().wstring();
-            if (name.rfind(L"bf2savefile", 0) != 0) continue; // prefix filter
-            files.push_back(std::move(name));
+static void SetListView(HWND hDlg, bool listView) {
+    if (listView == g_listView) return;
+    int sel = SelectedIndex(hDlg);
+    std::wstring select = sel >= 0 ? g_list.files[sel].name : std::wstring();
+
+    HWND hCombo = GetDlgItem(hDlg, IDC_COMBO_FILES);
+    HWND hList  = GetDlgItem(hDlg, IDC_LIST_FILES);
+    if (listView) SendMessageW(hCombo, CB_RESETCONTENT, 0, 0);
+    else          PopulateFileList(hList, 0);
+    ShowWindow(hCombo, listView ? SW_HIDE : SW_SHOW);
+    ShowWindow(hList,  listView ? SW_SHOW : SW_HIDE);
+
+    g_listView = listView;
+    SendMessageW(GetDlgItem(hDlg, IDC_LISTMODE), BM_SETCHECK, listView ? BST_CHECKED : BST_UNCHECKED, 0);
+    ShowSlots(hDlg, select);
+}
+
+// LVN_* from the owner-data list; returns true if handled.
+static bool OnListNotify(HWND hDlg, const NMHDR* hdr) {
+    if (hdr->code == LVN_GETDISPINFOW) {
+        auto* di = (NMLVDISPINFOW*)hdr;
+        const int file = RowToFile(di->item.iItem);
+        if ((di->item.mask & LVIF_TEXT) && file >= 0) {
+            const SlotEntry& f = g_list.files[file];
+            if (f.dupOf.empty()) di->item.pszText = (LPWSTR)f.name.c_str(); // stays valid until next change
+            else lstrcpynW(di->item.pszText, SlotLabel(f).c_str(), di->item.cchTextMax);
+        }
+        return true;
+    }
+    if (hdr->code == LVN_ODFINDITEMW) { // type-ahead: next name starting with the typed text
+        auto* fi = (NMLVFINDITEMW*)hdr;
+        LRESULT found = -1;
+        if (fi->lvfi.flags & (LVFI_STRING | LVFI_PARTIAL)) {
+            const size_t n = (size_t)RowCount(), len = wcslen(fi->lvfi.psz);
+            for (size_t k = 0; k < n && found < 0; ++k) {
+                size_t row = ((size_t)std::max(fi->iStart, 0) + k) % n;
+                const std::wstring& name = g_list.files[RowToFile((int)row)].name;
+                if (name.size() >= len && CompareStringOrdinal(name.c_str(), (int)len, fi->lvfi.psz, (int)len, TRUE) == CSTR_EQUAL) {
+                    found = (LRESULT)row;
+                }
+            }
         }
+        SetWindowLongPtrW(hDlg, DWLP_MSGRESULT, found);
+        return true;
     }
+    if (hdr->code == LVN_ITEMCHANGED) {
+        auto* lv = (const NMLISTVIEW*)hdr;
+        if ((lv->uChanged & LVIF_STATE) && (lv->uNewState & LVIS_SELECTED) && !(lv->uOldState & LVIS_SELECTED)) {
+            OnSelectionChanged(hDlg);
+        }
+        return true;
+    }
+    return false;
+}
 
-    std::sort(files.begin(), files.end(), NaturalLess);
+// A slot is marked as a duplicate when an earlier slot in the list has the same
+// content hash; the first of each group stays unmarked. Only relabeled rows are
+// touched, and the selection stays where it was.
+static void RefreshDuplicates(HWND hDlg) {
+    HWND hCombo = GetDlgItem(hDlg, IDC_COMBO_FILES);
+    const int sel = SelectedIndex(hDlg);
+    std::unordered_map<uint64_t, size_t> first;
+    bool relabeled = false;
 
-    for (const auto& f : files) {
-        SendMessageW(hCombo, CB_ADDSTRING, 0, (LPARAM)f.c_str());
+    for (size_t i = 0; i < g_list.files.size(); ++i) {
+        SlotEntry& f = g_list.files[i];
+        std::wstring dupOf;
+        if (f.hashed) {
+            auto [it, inserted] = first.emplace(f.hash, i);
+            if (!inserted) dupOf = g_list.files[it->second].name;
+        }
+        if (dupOf == f.dupOf) continue;
+        f.dupOf = std::move(dupOf);
+        const int row = FileToRow((int)i);
+        if (!g_listView && row >= 0) {
+            if (!relabeled) SendMessageW(hCombo, WM_SETREDRAW, FALSE, 0);
+            SendMessageW(hCombo, CB_DELETESTRING, row, 0);
+            SendMessageW(hCombo, CB_INSERTSTRING, row, (LPARAM)SlotLabel(f).c_str());
+        }
+        relabeled = true;
     }
-    if (!files.empty()) {
-        SendMessageW(hCombo, CB_SETCURSEL, 0, 0);
+    if (!relabeled) return;
+
+    if (g_listView) {
+        InvalidateRect(GetDlgItem(hDlg, IDC_LIST_FILES), nullptr, FALSE);
+    } else {
+        SendMessageW(hCombo, CB_SETCURSEL, FileToRow(sel), 0);
+        SendMessageW(hCombo, WM_SETREDRAW, TRUE, 0);
+        InvalidateRect(hCombo, nullptr, TRUE);
     }
 }
 
+// ---------- incremental updates from the watcher ----------
+// Unfiltered, rows are edited in place. Filtered, the view is rebuilt afterwards.
+static void ApplyDirChanges(HWND hDlg, const std::vector<DirChange>& changes) {
+    HWND hCombo = GetDlgItem(hDlg, IDC_COMBO_FILES);
+    int sel = SelectedIndex(hDlg);
+    const std::wstring selName = sel >= 0 ? g_list.files[sel].name : std::wstring();
+    const bool editRows = !g_listView && !Filtered();
+    bool changed = false;
+
+    for (const auto& c : changes) {
+        if (!IsSlotName(c.name, ListedProfile().pattern)) continue;
+        SlotEntry slot(c.name);
+        bool found = false;
+        auto it = FindSlot(slot, found);
+        int pos = (int)(it - g_list.files.begin());
+
+        if (c.action == FILE_ACTION_ADDED || c.action == FILE_ACTION_RENAMED_NEW_NAME) {
+            if (found) continue;
+            g_list.files.insert(it, std::move(slot));
+            if (editRows) SendMessageW(hCombo, CB_INSERTSTRING, pos, (LPARAM)c.name.c_str());
+            if (sel >= pos) ++sel;
+            changed = true;
+        } else if (c.action == FILE_ACTION_REMOVED || c.action == FILE_ACTION_RENAMED_OLD_NAME) {
+            if (!found) continue;
+            g_list.files.erase(it);
+            if (editRows) SendMessageW(hCombo, CB_DELETESTRING, pos, 0);
+            if (sel > pos || sel >= (int)g_list.files.size()) --sel;
+            changed = true;
+        }
+    }
+    if (!changed) return;
+    RequestFilterBuild(hDlg);
+
+    if (Filtered()) {
+        RefilterView();
+        ShowSlots(hDlg, selName);
+        RefreshDuplicates(hDlg);
+        return;
+    }
+    if (g_listView) PopulateFileList(GetDlgItem(hDlg, IDC_LIST_FILES), g_list.files.size(), LVSICF_NOSCROLL);
+    if (sel < 0 && !g_list.files.empty()) sel = 0;
+    SelectIndex(hDlg, sel);
+    RefreshDuplicates(hDlg); // a removed original hands its group to the next copy
+}
+
+// Skips the debounce, e.g. after Browse or loading the config.
+static void ScanNow(HWND hDlg) {
+    KillTimer(hDlg, kScanTimer);
+    RequestScan(hDlg, GetText(hDlg, IDC_EDIT_DIR), g_activeProfile);
+}
+
+// ---------- pre-staged restore ----------
+// Keeps one slot ready as a complete temp file next to the target, so restoring that
+// slot is just the rename. Staging runs on its own worker; the I/O thread consumes.
+class StagedSlot {
+public:
+    // Makes src the staged slot for dest, replacing (and deleting) whatever was staged.
+    void Stage(const fs::path& src, const fs::path& dest) {
+        FileStamp stamp;
+        std::error_code ec;
+        if (!StatFile(src.native(), stamp, ec)) return;
+
+        fs::path temp = TempPathFor(dest, L"stage");
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ready_ && src_ == src && dest_ == dest && stamp_ == stamp) return; // already there
+            DiscardLocked();
+        }
+
+        // Unlocked while copying: the consumer ignores a slot that is not ready.
+        bool ok;
+        if (g_cache.Enabled()) {
+            SaveBlob data;
+            ok = LoadSlot(src.native(), data, stamp, ec) && WriteWholeFile(temp.native(), *data, stamp, ec);
+        } else {
+            ok = CopyFileW(src.c_str(), temp.c_str(), FALSE) != 0;
+        }
+        if (!ok) { DeleteFileW(temp.c_str()); return; }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        src_ = src;
+        dest_ = dest;
+        temp_ = std::move(temp);
+        stamp_ = stamp;
+        ready_ = true;
+    }
+
+    // Swaps the staged file in if it is src's current contents. Returns false (ec
+    // untouched) when there is nothing usable staged and a normal restore is needed.
+    bool TryConsume(const fs::path& src, const fs::path& dest, std::error_code& ec) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ready_ || src_ != src || dest_ != dest) return false;
+
+        FileStamp now;
+        std::error_code statEc;
+        if (!StatFile(src.native(), now, statEc) || !(now == stamp_)) { // slot changed since staging
+            DiscardLocked();
+            return false;
+        }
+        ready_ = false;
+        g_backups.Swap(temp_, dest, ec);
+        return true;
+    }
+
+    void Discard() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        DiscardLocked();
+    }
+
+private:
+    void DiscardLocked() {
+        if (ready_) DeleteFileW(temp_.c_str());
+        ready_ = false;
+    }
+
+    std::mutex mutex_;
+    bool ready_ = false;
+    fs::path src_, dest_, temp_;
+    FileStamp stamp_;
+};
+
+static StagedSlot g_staged;
+
 // ---------- folder picker ----------
 static bool PickFolder(std::wstring& outFolder) {
     IFileDialog* pfd = nullptr;
@@ -132,14 +845,174 @@ static bool PickFolder(std::wstring& outFolder) {
     return !outFolder.empty();
 }
 
+// ---------- hotkey bindings ----------
+// Stored in config.txt as e.g. "hotkey_restore=Ctrl+Alt+R" or "hotkey_slot3=Ctrl+Num3",
+// at the top level or in the section of the profile they act on.
+enum : int {
+    kHotkeyRestore = 1,
+    kHotkeyNext,
+    kHotkeyPrev,
+    kHotkeyCapture,
+    kHotkeyUndo,
+    kHotkeySlotBase = 100, // "restore slot N" (Nth entry in the list) is kHotkeySlotBase + N
+    kHotkeySlotMax  = 9999,
+};
+
+struct HotkeyBinding {
+    int id = 0;
+    size_t profile = 0;
+    UINT mods = 0;  // MOD_*
+    UINT vk = 0;
+    std::string spec; // as written in config.txt
+};
+
+static std::string Lower(std::string s) {
+    for (auto& c : s) c = (char)tolower((unsigned char)c);
+    return s;
+}
+
+static bool ParseHotkey(const std::string& spec, UINT& mods, UINT& vk) {
+    static const struct { const char* name; UINT vk; } kNamed[] = {
+        { "left", VK_LEFT }, { "right", VK_RIGHT }, { "up", VK_UP }, { "down", VK_DOWN },
+        { "home", VK_HOME }, { "end", VK_END }, { "pageup", VK_PRIOR }, { "pagedown", VK_NEXT },
+        { "insert", VK_INSERT }, { "delete", VK_DELETE }, { "space", VK_SPACE }, { "enter", VK_RETURN },
+        { "tab", VK_TAB }, { "esc", VK_ESCAPE }, { "backspace", VK_BACK }, { "pause", VK_PAUSE },
+    };
+    mods = 0;
+    vk = 0;
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t plus = spec.find('+', start);
+        std::string tok = Lower(spec.substr(start, plus == std::string::npos ? std::string::npos : plus - start));
+        start = plus == std::string::npos ? spec.size() + 1 : plus + 1;
+
+        if (tok == "ctrl" || tok == "control") mods |= MOD_CONTROL;
+        else if (tok == "alt")   mods |= MOD_ALT;
+        else if (tok == "shift") mods |= MOD_SHIFT;
+        else if (tok == "win")   mods |= MOD_WIN;
+        else if (vk) return false; // two keys
+        else if (tok.size() == 1 && isalnum((unsigned char)tok[0])) vk = (UINT)toupper((unsigned char)tok[0]);
+        else if (tok.size() >= 2 && tok[0] == 'f' && isdigit((unsigned char)tok[1])) {
+            int n = atoi(tok.c_str() + 1);
+            if (n < 1 || n > 24) return false;
+            vk = VK_F1 + (UINT)(n - 1);
+        } else if (tok.size() == 4 && tok.rfind("num", 0) == 0 && isdigit((unsigned char)tok[3])) {
+            vk = VK_NUMPAD0 + (UINT)(tok[3] - '0');
+        } else {
+            for (const auto& k : kNamed) if (tok == k.name) vk = k.vk;
+            if (!vk) return false;
+        }
+    }
+    return vk != 0;
+}
+
+static std::string HotkeyConfigKey(int id) {
+    switch (id) {
+    case kHotkeyRestore: return "hotkey_restore";
+    case kHotkeyNext:    return "hotkey_next";
+    case kHotkeyPrev:    return "hotkey_prev";
+    case kHotkeyCapture: return "hotkey_capture";
+    case kHotkeyUndo:    return "hotkey_undo";
+    default:             return "hotkey_slot" + std::to_string(id - kHotkeySlotBase);
+    }
+}
+// 0 if key is not a hotkey setting.
+static int HotkeyIdFromConfigKey(const std::string& key) {
+    if (key == "hotkey_restore") return kHotkeyRestore;
+    if (key == "hotkey_next")    return kHotkeyNext;
+    if (key == "hotkey_prev")    return kHotkeyPrev;
+    if (key == "hotkey_capture") return kHotkeyCapture;
+    if (key == "hotkey_undo")    return kHotkeyUndo;
+    if (key.rfind("hotkey_slot", 0) == 0 && key.size() > 11) {
+        int n = atoi(key.c_str() + 11);
+        if (n >= 1 && n <= kHotkeySlotMax - kHotkeySlotBase) return kHotkeySlotBase + n;
+    }
+    return 0;
+}
+
 // ---------- config load/save ----------
-static void SaveConfig(const std::wstring& folder, const std::wstring& file, bool pinOnTop) {
-    auto configPath = GetExeDir() / L"config.txt";
-    std::ofstream out(configPath.string(), std::ios::binary);
-    out << "directory=" << ToUtf8(folder) << "\n";
-    out << "file=" << ToUtf8(file) << "\n";
-    out << "pin=" << (pinOnTop ? "1" : "0") << "\n";
+// Tunables that only come from config.txt (no UI of their own).
+struct Settings {
+    size_t cacheMb = 0; // RAM save cache budget; 0 = off, always copy from disk
+    RestoreMode restoreMode = RestoreMode::Copy;
+    std::vector<HotkeyBinding> hotkeys; // every profile's; registered as index + 1
+    bool prestage = false; // keep the likely next slot staged beside the target
+    bool prefetch = true;  // read the selected slot into the file cache before it is restored
+    bool pipe = false;     // serve \\.\pipe\Directorizer for scripts
+    bool verify = false;   // hash the target after each restore and compare with the slot
+    bool index = false;    // keep a content index of the folder and mark duplicate slots
+    size_t backups = 0;    // targets kept in ~dz_backups before each restore; 0 = none
+    IoOptions io;          // io_priority, sequential_scan, flush, share_wait_ms
+};
+static Settings g_settings;
+
+static size_t ParseSize(const std::string& s) {
+    return (size_t)std::strtoull(s.c_str(), nullptr, 10);
+}
+
+// config.txt, loaded once into memory. Changes go into it as they happen and reach
+// the disk from FlushConfig at most once per kConfigSaveMs, not on every Overwrite.
+static ConfigStore g_config;
+static bool g_configSavePending = false; // kConfigTimer is armed
+
+static fs::path ConfigPath() { return GetExeDir() / L"config.txt"; }
+
+// Folder, selection, pattern, target and hotkeys of one profile. Pattern and target
+// are only written out once they differ from the default.
+static void StoreProfileKeys(size_t index) {
+    const Profile& p = g_profiles[index];
+    auto set = [&](const char* key, const std::wstring& value, const std::wstring& fallback) {
+        if (value != fallback || g_config.Find(p.section, key)) g_config.Set(p.section, key, ToUtf8(value));
+    };
+    g_config.Set(p.section, "directory", ToUtf8(p.folder));
+    g_config.Set(p.section, "file", ToUtf8(p.file));
+    set("pattern", p.pattern, kDefaultPattern);
+    set("target", p.target, Profile{}.target);
+    for (const auto& hk : g_settings.hotkeys) {
+        if (hk.profile == index) g_config.Set(p.section, HotkeyConfigKey(hk.id), hk.spec);
+    }
+}
+
+static void SaveConfig(HWND hDlg) {
+    const bool pin = SendMessageW(GetDlgItem(hDlg, IDC_PIN), BM_GETCHECK, 0, 0) == BST_CHECKED;
+    StoreProfileKeys(0);
+    if (g_activeProfile != 0 || g_config.Find("", "profile")) {
+        g_config.Set("", "profile", g_activeProfile != 0 ? ToUtf8(g_profiles[g_activeProfile].name) : "");
+    }
+    g_config.Set("", "pin", pin ? "1" : "0");
+    g_config.Set("", "listview", g_listView ? "1" : "0");
+    g_config.Set("", "cache_mb", std::to_string(g_settings.cacheMb));
+    g_config.Set("", "restore_mode", RestoreModeName(g_settings.restoreMode));
+    g_config.Set("", "prestage", g_settings.prestage ? "1" : "0");
+    g_config.Set("", "prefetch", g_settings.prefetch ? "1" : "0");
+    g_config.Set("", "pipe", g_settings.pipe ? "1" : "0");
+    g_config.Set("", "verify", g_settings.verify ? "1" : "0");
+    g_config.Set("", "index", g_settings.index ? "1" : "0");
+    g_config.Set("", "backups", std::to_string(g_settings.backups));
+    g_config.Set("", "io_priority", IoPriorityName(g_settings.io.priority));
+    g_config.Set("", "sequential_scan", g_settings.io.sequentialScan ? "1" : "0");
+    g_config.Set("", "flush", FlushModeName(g_settings.io.flush));
+    g_config.Set("", "share_wait_ms", std::to_string(g_settings.io.shareWaitMs));
+    for (size_t i = 1; i < g_profiles.size(); ++i) StoreProfileKeys(i);
+
+    if (g_config.Dirty() && !g_configSavePending) {
+        g_configSavePending = true;
+        SetTimer(hDlg, kConfigTimer, kConfigSaveMs, nullptr);
+    }
 }
+
+// On kConfigTimer and on exit.
+static void FlushConfig(HWND hDlg) {
+    KillTimer(hDlg, kConfigTimer);
+    g_configSavePending = false;
+    if (!g_config.Dirty()) return;
+    std::error_code ec;
+    g_config.Save(ec);
+    TraceLoggingWrite(g_trace, "ConfigSave", TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+                      TraceLoggingWideString(ConfigPath().c_str(), "Path"),
+                      TraceLoggingBool(!ec, "Success"));
+}
+
 static void ApplyPin(HWND hDlg, bool pin) {
     SetWindowPos(
         hDlg,
@@ -149,48 +1022,887 @@ static void ApplyPin(HWND hDlg, bool pin) {
     );
     SendMessageW(GetDlgItem(hDlg, IDC_PIN), BM_SETCHECK, pin ? BST_CHECKED : BST_UNCHECKED, 0);
 }
+// UI state saved in config.txt; the tunables go straight into g_settings and the
+// profiles into g_profiles.
+struct ConfigFile {
+    std::wstring profile; // active one, by name; empty = profile 0
+    bool pin = false, listView = false;
+};
+
+static bool Flag(const std::string& value) { return !value.empty() && value[0] == '1'; }
+
+// One key of config.txt; section is the index of the profile it appeared under.
+static void ApplyConfigKey(ConfigFile& cfg, size_t section, const std::string& key, const std::string& value) {
+    Profile& prof = g_profiles[section];
+    if (key == "directory")            prof.folder = FromUtf8(value);
+    else if (key == "file")            prof.file = FromUtf8(value);
+    else if (key == "pattern")         { if (!value.empty()) prof.pattern = FromUtf8(value); }
+    else if (key == "target")          { if (!value.empty()) prof.target = FromUtf8(value); }
+    else if (key == "profile")         cfg.profile = FromUtf8(value);
+    else if (key == "pin")             cfg.pin = Flag(value);
+    else if (key == "listview")        cfg.listView = Flag(value);
+    else if (key == "cache_mb")        g_settings.cacheMb = ParseSize(value);
+    else if (key == "restore_mode")    g_settings.restoreMode = ParseRestoreMode(value);
+    else if (key == "prestage")        g_settings.prestage = Flag(value);
+    else if (key == "prefetch")        g_settings.prefetch = Flag(value);
+    else if (key == "pipe")            g_settings.pipe = Flag(value);
+    else if (key == "verify")          g_settings.verify = Flag(value);
+    else if (key == "index")           g_settings.index = Flag(value);
+    else if (key == "backups")         g_settings.backups = ParseSize(value);
+    else if (key == "io_priority")     g_settings.io.priority = ParseIoPriority(value);
+    else if (key == "sequential_scan") g_settings.io.sequentialScan = value != "0";
+    else if (key == "flush")           g_settings.io.flush = ParseFlushMode(value);
+    else if (key == "share_wait_ms")   g_settings.io.shareWaitMs = (uint32_t)std::min<size_t>(ParseSize(value), 60000);
+    else if (int id = HotkeyIdFromConfigKey(key)) {
+        HotkeyBinding hk;
+        hk.id = id;
+        hk.profile = section;
+        hk.spec = value;
+        if (ParseHotkey(hk.spec, hk.mods, hk.vk)) g_settings.hotkeys.push_back(std::move(hk));
+    }
+}
+
+// (Re)loads g_config and rebuilds g_settings and g_profiles from it. Sections other
+// than "[profile Name]", and repeats of a name, are kept in the file but ignored.
+// Loads into a scratch store first: g_config, g_settings and g_profiles are only
+// replaced once the file has been read, so a config caught mid-save (locked, or
+// truncated by an editor that rewrites it) leaves everything as it was. ec is set
+// for such a transient failure and clear when there simply is no file. acceptEmpty:
+// the file has stayed empty long enough to be meant that way.
+static bool ReadConfig(ConfigFile& cfg, std::error_code& ec, bool acceptEmpty = false) {
+    const fs::path configPath = ConfigPath();
+    ConfigStore store;
+    bool found = store.Load(configPath, ec);
+    auto empty = [](const ConfigStore& c) { return c.Sections().size() == 1 && c.Sections()[0].entries.empty(); };
+    if (found && !acceptEmpty && empty(store) && !empty(g_config)) {
+        found = false;
+        ec = std::make_error_code(std::errc::resource_unavailable_try_again);
+    }
+    TraceLoggingWrite(g_trace, "ConfigLoad", TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+                      TraceLoggingWideString(configPath.c_str(), "Path"),
+                      TraceLoggingBool(found, "Found"),
+                      TraceLoggingInt32(ec.value(), "Error"));
+    if (!found) {
+        if (!ec) g_config = std::move(store); // no file: the next save creates it from the current state
+        return false;
+    }
+    g_config = std::move(store);
+    g_settings = Settings{};
+    g_profiles.assign(1, Profile{});
+
+    for (const auto& sec : g_config.Sections()) {
+        size_t section = 0;
+        if (!sec.name.empty()) {
+            if (sec.name.rfind("profile ", 0) != 0 || sec.name.size() <= 8) continue;
+            Profile next;
+            next.section = sec.name;
+            next.name = FromUtf8(sec.name.substr(8));
+            if (FindProfile(next.name) >= 0) continue;
+            section = g_profiles.size();
+            g_profiles.push_back(std::move(next));
+        }
+        for (const auto& e : sec.entries) {
+            if (!e.key.empty()) ApplyConfigKey(cfg, section, e.key, e.value);
+        }
+    }
+    return true;
+}
+
+// The tunables that take effect without a restart.
+static void ApplySettings() {
+    g_cache.SetBudget(g_settings.cacheMb << 20);
+    g_backups.SetDepth(g_settings.backups);
+    SetIoOptions(g_settings.io);
+}
+
 static bool LoadConfig(HWND hDlg) {
-    auto configPath = GetExeDir() / L"config.txt";
-    std::ifstream in(configPath.string(), std::ios::binary);
-    if (!in) return false;
+    ConfigFile cfg;
+    std::error_code ec;
+    if (!ReadConfig(cfg, ec)) return false;
+    g_activeProfile = (size_t)std::max(FindProfile(cfg.profile), 0);
+    const Profile& active = g_profiles[g_activeProfile];
+
+    ApplySettings();
+    SetListView(hDlg, cfg.listView);
+
+    if (!active.folder.empty()) {
+        SetText(hDlg, IDC_EDIT_DIR, active.folder);
+    }
+    g_pendingFile = active.file; // selected once the scan below lands
+    ScanNow(hDlg);
+    ApplyPin(hDlg, cfg.pin);
+    return true;
+}
+
+// ---------- global hotkeys ----------
+// Fire while the game has focus. MOD_NOREPEAT keeps a held key from queueing restores.
+// One combination can only be registered once, so profiles need distinct keys.
+static void RegisterHotkeys(HWND hDlg) {
+    int failed = 0;
+    for (size_t i = 0; i < g_settings.hotkeys.size(); ++i) {
+        const auto& hk = g_settings.hotkeys[i];
+        if (!RegisterHotKey(hDlg, (int)i + 1, hk.mods | MOD_NOREPEAT, hk.vk)) ++failed;
+    }
+    if (failed) {
+        SetText(hDlg, IDC_STATUS, L"Hotkey in use");
+        SetTimer(hDlg, kStatusTimer, 2500, nullptr);
+    }
+}
+static void UnregisterHotkeys(HWND hDlg) {
+    for (size_t i = 0; i < g_settings.hotkeys.size(); ++i) UnregisterHotKey(hDlg, (int)i + 1);
+}
+
+// ---------- content index (duplicate detection) ----------
+// The index lives in index\<folder hash>.idx next to the exe and is only touched by
+// g_indexWorker. A full pass runs after each scan (rehashing only files whose size or
+// mtime moved); watcher batches update just the names they mention.
+struct IndexResult {
+    uint64_t generation = 0;
+    std::vector<std::pair<std::wstring, IndexEntry>> known;
+};
+
+static std::unique_ptr<JobWorker> g_indexWorker;
+static SlotIndex g_index; // index worker only
+
+static void RequestIndex(HWND hDlg, const std::wstring& folder, std::vector<std::wstring> names, bool full) {
+    if (!g_settings.index || !g_indexWorker || folder.empty() || IsPackPath(folder)) return; // packs carry hashes
+    const uint64_t gen = g_scanGeneration.load();
+    g_indexWorker->Submit([hDlg, folder, names = std::move(names), full, gen] {
+        std::error_code ec;
+        if (g_index.Folder() != folder) {
+            g_index.SaveIfDirty(ec);
+            g_index.Open(folder, IndexPathFor(GetExeDir() / L"index", folder));
+        }
+        auto result = std::make_unique<IndexResult>();
+        result->generation = gen;
+        bool complete = true;
+        for (const auto& name : names) {
+            if (g_scanGeneration.load() != gen) { complete = false; break; } // folder changed; a new pass follows
+            IndexEntry e;
+            if (g_index.Update(name, e)) result->known.emplace_back(name, e);
+        }
+        if (full && complete) g_index.Retain(names);
+        g_index.SaveIfDirty(ec);
+        if (PostMessageW(hDlg, WM_APP_INDEX_DONE, 0, (LPARAM)result.get())) result.release();
+    }, full ? kCoalesceIndex : kCoalesceNone);
+}
+
+static void RequestFullIndex(HWND hDlg) {
+    std::vector<std::wstring> names;
+    names.reserve(g_list.files.size());
+    for (const auto& f : g_list.files) names.push_back(f.name);
+    RequestIndex(hDlg, g_list.folder, std::move(names), true);
+}
 
+static void ApplyIndex(HWND hDlg, const IndexResult& result) {
+    for (const auto& [name, e] : result.known) {
+        bool found = false;
+        auto it = FindSlot(SlotEntry(name), found);
+        if (!found) continue;
+        it->hash = e.hash;
+        it->hashed = true;
+    }
+    RefreshDuplicates(hDlg);
+}
+
+// ---------- overwrite ----------
+// Byte count comes from the target after the fact so every strategy reports the same way.
+static void TraceRestore(const fs::path& src, const fs::path& dest, const char* strategy,
+                         const RestoreTiming& timing, const std::error_code& ec) {
+    FileStamp stamp;
+    std::error_code statEc;
+    if (ec || !StatFile(dest.native(), stamp, statEc)) stamp.size = 0;
+    TraceLoggingWrite(g_trace, "Restore", TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+                      TraceLoggingWideString(src.c_str(), "Source"),
+                      TraceLoggingString(strategy, "Strategy"),
+                      TraceLoggingUInt64(stamp.size, "Bytes"),
+                      TraceLoggingFloat64(QpcToUs(timing.ticks[kSeriesTotal]) / 1000.0, "DurationMs"),
+                      TraceLoggingFloat64(QpcToUs(timing.ticks[kSeriesWait]) / 1000.0, "WaitMs"),
+                      TraceLoggingInt32(ec.value(), "Error"));
+}
+
+// Restores run on the I/O thread; a restore still queued when a newer one arrives is
+// dropped, and only the ones that ran report back via WM_APP_RESTORE_DONE.
+static std::unique_ptr<JobWorker> g_ioWorker;
+static std::unique_ptr<JobWorker> g_stageWorker;
+
+// Lets other threads wait for a particular restore. Restores finish in request order,
+// so one that never ran is recognised by a later sequence number finishing first.
+class RestoreTracker {
+public:
+    enum Outcome { kOk, kFailed, kSuperseded, kCancelled };
+
+    uint64_t Begin() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ++issued_;
+    }
+    void Finish(uint64_t seq, bool ok) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_ = seq;
+            lastOk_ = ok;
+        }
+        cv_.notify_all();
+    }
+    void Shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            shutdown_ = true;
+        }
+        cv_.notify_all();
+    }
+    Outcome Wait(uint64_t seq) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return shutdown_ || finished_ >= seq; });
+        if (finished_ < seq) return kCancelled;
+        if (finished_ > seq) return kSuperseded;
+        return lastOk_ ? kOk : kFailed;
+    }
+    // "ok", "failed" or "none" for the most recent restore that ran.
+    const char* LastResult() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return finished_ == 0 ? "none" : lastOk_ ? "ok" : "failed";
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t issued_ = 0, finished_ = 0;
+    bool lastOk_ = false, shutdown_ = false;
+};
+
+static RestoreTracker g_restores;
+
+static fs::path TargetPath(const std::wstring& folder, const Profile& profile) {
+    return SlotDir(folder) / profile.target; // next to a .dzpack, not inside it
+}
+
+// Slots are usually stepped through in list order, so the staged one is whichever
+// the user will most likely fire next: the selection, or the slot after a restore.
+static void StageSlot(int idx, bool force = false) {
+    if (!(g_settings.prestage || force) || !g_stageWorker || idx < 0 || idx >= (int)g_list.files.size()) return;
+    if (IsPackPath(g_list.folder)) return; // already mapped
+    fs::path src  = fs::path(g_list.folder) / g_list.files[idx].name;
+    fs::path dest = TargetPath(g_list.folder, ListedProfile());
+    g_stageWorker->Submit([src, dest] { g_staged.Stage(src, dest); }, kCoalesceStage);
+}
+
+// ---------- prefetch ----------
+// The selected slot is read as soon as it is picked, on a thread in background mode
+// (low CPU and I/O priority), so the first Overwrite of a cold slot on an HDD or a
+// share does not wait on the disk. A newer pick stops the read in flight. Staging
+// reads the slot itself, so prestage=1 makes this redundant.
+static std::unique_ptr<JobWorker> g_prefetchWorker;
+static std::atomic<uint64_t> g_prefetchGeneration{0};
+
+static void PrefetchSelected(int idx) {
+    if (!g_settings.prefetch || g_settings.prestage || !g_prefetchWorker) return;
+    const uint64_t gen = ++g_prefetchGeneration;
+    if (idx < 0 || idx >= (int)g_list.files.size() || IsPackPath(g_list.folder)) return; // packs are mapped
+    fs::path src = fs::path(g_list.folder) / g_list.files[idx].name;
+    g_prefetchWorker->Submit([src = std::move(src), gen] {
+        std::error_code ec;
+        PrefetchSlot(src, [gen] { return gen != g_prefetchGeneration.load(); }, ec);
+    }, kCoalescePrefetch);
+}
+
+// ---------- restore source ----------
+// Folder, name and both paths of the selected slot, rebuilt only when the selection,
+// the listing or the target changes. A restore hands the shared copy to the I/O
+// thread as it is, so the click itself builds no paths and reads no control text.
+struct RestoreSource {
+    std::wstring folder, name; // name is empty when nothing is selected
+    std::wstring target;       // profile target dest was built from
+    fs::path src, dest;
+};
+
+static std::shared_ptr<const RestoreSource> g_source;       // the selection's
+static std::shared_ptr<const RestoreSource> g_lastRestored; // most recently requested restore
+
+// g_source, brought up to date if anything it was built from moved. Comparisons
+// only; allocates just when it has to rebuild.
+static const std::shared_ptr<const RestoreSource>& CurrentSource(HWND hDlg) {
+    static const std::wstring kNone;
+    const int idx = SelectedIndex(hDlg);
+    const std::wstring& name = idx >= 0 ? g_list.files[idx].name : kNone;
+    const Profile& profile = ListedProfile();
+    if (g_source && g_source->name == name && g_source->folder == g_list.folder && g_source->target == profile.target) {
+        return g_source;
+    }
+    auto source = std::make_shared<RestoreSource>();
+    source->folder = g_list.folder;
+    source->name = name;
+    source->target = profile.target;
+    source->src = fs::path(g_list.folder) / name;
+    source->dest = TargetPath(g_list.folder, profile);
+    g_source = std::move(source);
+    return g_source;
+}
+
+static void OnSelectionChanged(HWND hDlg) {
+    CurrentSource(hDlg);
+    StageSlot(SelectedIndex(hDlg));
+    PrefetchSelected(SelectedIndex(hDlg));
+}
+
+// Shared by the Overwrite button, the hotkeys and the pipe. Returns the restore's
+// sequence number for g_restores.Wait(). With the selection unchanged since the last
+// click, a repeat restore does not touch the heap on either thread: the UI side
+// builds no paths and reads no control text, the job's captures fit std::function's
+// inline buffer, and the config only changes when a different slot is restored. On
+// the I/O thread RestoreSlot reuses its per-thread temp name, read buffer and delta
+// lists. Still allocating: backups=N (the ring lists its folder), a RAM cache miss
+// (the copy it keeps), slot groups, busy-target retries and tracing.
+static uint64_t RestoreSelected(HWND hDlg) {
+    std::shared_ptr<const RestoreSource> source = CurrentSource(hDlg);
+
+    const RestoreMode mode = g_settings.restoreMode;
+    const bool verify = g_settings.verify;
+    const uint64_t seq = g_restores.Begin();
+    g_lastRestored = source;
+    g_ioWorker->Submit([hDlg, source = std::move(source), mode, verify, seq] {
+        const fs::path& src = source->src;
+        const fs::path& dest = source->dest;
+        std::error_code ec;
+        RestoreTiming timing;
+        const int64_t start = QpcNow();
+        bool staged = false;
+        if (source->name.empty()) {
+            ec = std::make_error_code(std::errc::no_such_file_or_directory);
+        } else if (g_staged.TryConsume(src, dest, ec) && !IsTargetBusy(ec, dest)) { // prestage=1 or STAGE
+            timing.ticks[kSeriesRename] = QpcNow() - start;
+            staged = true;
+        } else { // a staged swap that hit a busy target is retried here as a normal restore
+            RestoreSlot(src, dest, mode, ec, &timing);
+        }
+        timing.ticks[kSeriesTotal] = QpcNow() - start;
+        bool matched = true;
+        if (!ec && verify) {
+            const int64_t verifyStart = QpcNow();
+            VerifyRestore(src, dest, matched, ec);
+            timing.ticks[kSeriesVerify] = QpcNow() - verifyStart;
+        }
+        if (!ec) g_latency.Record(timing);
+        else if (timing.ticks[kSeriesWait]) g_latency.Record(kSeriesWait, QpcToUs(timing.ticks[kSeriesWait]));
+        if (TraceEnabled()) TraceRestore(src, dest, staged ? "staged" : RestoreModeName(mode), timing, ec);
+        g_restores.Finish(seq, !ec && matched);
+        const WPARAM result = ec ? (IsTargetBusy(ec, dest) ? 3 : 0) : matched ? 1 : 2;
+        PostMessageW(hDlg, WM_APP_RESTORE_DONE, result, (LPARAM)(QpcToUs(timing.ticks[kSeriesWait]) / 1000.0 + 0.5));
+    }, kCoalesceRestore);
+
+    Profile& listed = g_profiles[g_list.profile];
+    if (listed.folder != g_lastRestored->folder || listed.file != g_lastRestored->name) {
+        listed.folder = g_lastRestored->folder;
+        listed.file = g_lastRestored->name;
+        SaveConfig(hDlg); // written later by FlushConfig, off the restore path
+    }
+    return seq;
+}
+
+// Puts back the target from before the last restore (the newest backup), or every
+// target of the group if that was a slot group. Queued behind any restore still
+// running, so it undoes that one.
+static void UndoRestore(HWND hDlg) {
+    if (g_list.folder.empty() || !g_ioWorker) return;
+    const fs::path dest = TargetPath(g_list.folder, ListedProfile());
+    const fs::path last = g_lastRestored && !g_lastRestored->name.empty() ? g_lastRestored->src : fs::path();
+    g_ioWorker->Submit([hDlg, dest, last] {
+        std::vector<fs::path> targets{ dest };
+        if (!last.empty() && IsSlotGroup(last)) {
+            targets.clear();
+            for (const auto& name : GroupFiles(last)) targets.push_back(dest.parent_path() / name);
+        }
+        std::error_code ec;
+        bool undone = false;
+        for (const auto& t : targets) {
+            std::error_code one;
+            undone |= g_backups.Undo(t, one);
+            if (one) ec = one;
+        }
+        PostMessageW(hDlg, WM_APP_UNDO_DONE, ec ? 0 : undone ? 1 : 2, 0);
+    }, kCoalesceNone);
+}
+
+// ---------- capture ----------
+// Copies the target into a new slot numbered after the last one in the list. The
+// name is claimed on the UI thread, so captures queued back to back never collide.
+struct CaptureResult {
+    std::wstring folder, name;
+    std::error_code ec;
+};
+
+static std::vector<std::wstring> g_capturing; // names claimed by captures still on the I/O thread
+
+static void CaptureTarget(HWND hDlg) {
+    const std::wstring folder = g_list.folder;
+    if (folder.empty() || !g_ioWorker) return;
+    if (IsPackPath(folder)) { // archives are written whole by --pack
+        SetText(hDlg, IDC_STATUS, L"Cannot capture into a .dzpack");
+        SetTimer(hDlg, kStatusTimer, 2500, nullptr);
+        return;
+    }
+    const fs::path target = TargetPath(folder, ListedProfile());
+
+    std::wstring name = NextSlotName(g_list.files, target.extension().native(), [](const std::wstring& n) {
+        return FindSlotIndex(n) >= 0 || std::find(g_capturing.begin(), g_capturing.end(), n) != g_capturing.end();
+    }, CapturePrefix(ListedProfile()));
+    g_capturing.push_back(name);
+    g_ioWorker->Submit([hDlg, folder, target, name] {
+        auto result = std::make_unique<CaptureResult>();
+        result->folder = folder;
+        result->name = name;
+        CaptureFile(target, fs::path(folder) / name, result->ec);
+        if (PostMessageW(hDlg, WM_APP_CAPTURE_DONE, 0, (LPARAM)result.get())) result.release();
+    }, kCoalesceNone);
+}
+
+static void OnCaptureDone(HWND hDlg, const CaptureResult& result) {
+    g_capturing.erase(std::remove(g_capturing.begin(), g_capturing.end(), result.name), g_capturing.end());
+    SetText(hDlg, IDC_STATUS, result.ec ? L"Capture failed" : L"Captured " + result.name);
+    SetTimer(hDlg, kStatusTimer, 2500, nullptr);
+    if (result.ec || result.folder != g_list.folder) return;
+
+    // Into the list now; the watcher's own event for it is then a no-op.
+    ApplyDirChanges(hDlg, { DirChange{ FILE_ACTION_ADDED, result.name } });
+    RequestIndex(hDlg, result.folder, { result.name }, false);
+}
+
+// ---------- compare ----------
+// The first press of Compare marks the selected slot; the next press, with another
+// slot selected, diffs the two on the index worker (restores never wait behind it)
+// and lists the differing ranges, with diff.csv for all of them.
+constexpr size_t kDiffMergeGap = 8; // differing bytes this close together are one range
+constexpr size_t kDiffShown = 12;   // ranges listed in the result box
+
+struct DiffResult {
+    std::shared_ptr<const RestoreSource> a, b;
+    SlotDiff diff;
+    double us = 0;
+    std::error_code ec;
+};
+
+static std::shared_ptr<const RestoreSource> g_compareMark;
+
+static void CompareSelected(HWND hDlg) {
+    std::shared_ptr<const RestoreSource> source = CurrentSource(hDlg);
+    if (source->name.empty() || !g_indexWorker) return;
+    if (!g_compareMark || g_compareMark->folder != source->folder || g_compareMark->name == source->name) {
+        g_compareMark = std::move(source);
+        SetText(hDlg, IDC_STATUS, L"Compare " + g_compareMark->name + L" with...");
+        SetTimer(hDlg, kStatusTimer, 5000, nullptr);
+        return;
+    }
+    g_indexWorker->Submit([hDlg, a = std::exchange(g_compareMark, nullptr), b = std::move(source)] {
+        auto result = std::make_unique<DiffResult>();
+        result->a = a;
+        result->b = b;
+        const int64_t start = QpcNow();
+        DiffSlots(a->src, b->src, kDiffMergeGap, result->diff, result->ec);
+        result->us = QpcToUs(QpcNow() - start);
+        TraceLoggingWrite(g_trace, "Diff", TraceLoggingLevel(WINEVENT_LEVEL_INFO),
+                          TraceLoggingString(DiffEngineName(), "Engine"),
+                          TraceLoggingUInt64(std::max(result->diff.sizeA, result->diff.sizeB), "Bytes"),
+                          TraceLoggingUInt32((UINT32)result->diff.ranges.size(), "Ranges"),
+                          TraceLoggingFloat64(result->us / 1000.0, "DurationMs"));
+        if (PostMessageW(hDlg, WM_APP_DIFF_DONE, 0, (LPARAM)result.get())) result.release();
+    }, kCoalesceNone);
+}
+
+static void OnDiffDone(HWND hDlg, const DiffResult& result) {
+    if (result.ec) {
+        SetText(hDlg, IDC_STATUS, L"Compare failed");
+        SetTimer(hDlg, kStatusTimer, 2500, nullptr);
+        return;
+    }
+    const SlotDiff& d = result.diff;
+    std::wstring text = result.a->name + L"  vs  " + result.b->name + L"\n";
+    wchar_t line[160];
+    swprintf(line, 160, L"%llu / %llu bytes, %zu ranges, %llu bytes differ (%hs, %.2f ms)\n",
+             (unsigned long long)d.sizeA, (unsigned long long)d.sizeB, d.ranges.size(),
+             (unsigned long long)d.Differing(), DiffEngineName(), result.us / 1000.0);
+    text += line;
+    if (d.ranges.empty()) {
+        MessageBoxW(hDlg, (text + L"\nIdentical.").c_str(), L"Compare", MB_OK | MB_ICONINFORMATION);
+        return;
+    }
+    text += L"\n";
+    for (size_t i = 0; i < d.ranges.size() && i < kDiffShown; ++i) {
+        swprintf(line, 160, L"0x%08llx  +%llu\n    a: %hs\n    b: %hs\n", (unsigned long long)d.ranges[i].offset,
+                 (unsigned long long)d.ranges[i].length, d.hexA[i].c_str(), d.hexB[i].c_str());
+        text += line;
+    }
+    if (d.ranges.size() > kDiffShown) text += L"... and " + std::to_wstring(d.ranges.size() - kDiffShown) + L" more\n";
+    text += L"\nSave all ranges to diff.csv?";
+    if (MessageBoxW(hDlg, text.c_str(), L"Compare", MB_YESNO | MB_ICONINFORMATION) != IDYES) return;
+
+    std::ofstream csv(GetExeDir() / L"diff.csv", std::ios::binary);
+    bool saved = csv && d.WriteCsv(csv);
+    SetText(hDlg, IDC_STATUS, saved ? L"Saved diff.csv" : L"Failed");
+    SetTimer(hDlg, kStatusTimer, 2500, nullptr);
+}
+
+static void RunHotkey(HWND hDlg, int id) {
+    const int count = RowCount(); // next/prev and slot N follow the visible rows
+    if (id == kHotkeyRestore) {
+        RestoreSelected(hDlg);
+    } else if (id == kHotkeyCapture) {
+        CaptureTarget(hDlg);
+    } else if (id == kHotkeyUndo) {
+        UndoRestore(hDlg);
+    } else if (id == kHotkeyNext || id == kHotkeyPrev) {
+        if (!count) return;
+        int row = FileToRow(SelectedIndex(hDlg)) + (id == kHotkeyNext ? 1 : -1);
+        SelectIndex(hDlg, RowToFile(std::clamp(row, 0, count - 1)));
+    } else if (id > kHotkeySlotBase && id <= kHotkeySlotMax) {
+        int slot = id - kHotkeySlotBase - 1;
+        if (slot >= count) return;
+        SelectIndex(hDlg, RowToFile(slot));
+        RestoreSelected(hDlg);
+    }
+}
+
+// ---------- profile switching ----------
+static int g_pendingHotkey = 0; // action held until the switched-to profile is listed
+
+// Keeps the listed profile's folder and pick for when it is switched back to, then
+// rescans for the new one. The list below stays up until that scan lands.
+static void SwitchProfile(HWND hDlg, size_t index) {
+    if (index >= g_profiles.size() || index == g_activeProfile) return;
+    Profile& listed = g_profiles[g_list.profile];
+    if (!g_list.folder.empty()) {
+        listed.folder = g_list.folder;
+        const int sel = SelectedIndex(hDlg);
+        if (sel >= 0) listed.file = g_list.files[sel].name;
+    }
+    g_activeProfile = index;
+    g_pendingHotkey = 0;
+    SendDlgItemMessageW(hDlg, IDC_COMBO_PROFILE, CB_SETCURSEL, index, 0);
+
+    const Profile& next = g_profiles[index];
+    SetText(hDlg, IDC_EDIT_DIR, next.folder);
+    g_pendingFile = next.file;
+    ScanNow(hDlg);
+    SaveConfig(hDlg);
+}
+
+static void FillProfiles(HWND hDlg) {
+    HWND hCombo = GetDlgItem(hDlg, IDC_COMBO_PROFILE);
+    SendMessageW(hCombo, CB_RESETCONTENT, 0, 0);
+    for (const auto& p : g_profiles) SendMessageW(hCombo, CB_ADDSTRING, 0, (LPARAM)p.name.c_str());
+    SendMessageW(hCombo, CB_SETCURSEL, g_activeProfile, 0);
+    EnableWindow(hCombo, g_profiles.size() > 1);
+}
+
+// A hotkey acts on its own profile: one for another profile switches to it first and
+// runs once that profile's scan is in, so "slot 3" means its third slot.
+static void OnHotkey(HWND hDlg, int regId) {
+    if (regId < 1 || regId > (int)g_settings.hotkeys.size()) return;
+    const HotkeyBinding& hk = g_settings.hotkeys[regId - 1];
+    SwitchProfile(hDlg, hk.profile);
+    if (g_list.profile != g_activeProfile || g_list.generation != g_scanGeneration.load() || g_list.provisional) {
+        g_pendingHotkey = hk.id;
+        return;
+    }
+    RunHotkey(hDlg, hk.id);
+}
+
+// "Success!  1.84 ms (med 1.61, p99 4.20)" for the status label, into buf.
+static void SuccessText(wchar_t* buf, size_t size, int waitedMs) {
+    LatencyStats::Summary s = g_latency.Summarize(kSeriesTotal);
+    int n = swprintf(buf, size, L"Success!  %.2f ms (med %.2f, p99 %.2f)", s.last / 1000.0, s.median / 1000.0,
+                     s.p99 / 1000.0);
+    if (waitedMs > 0 && n > 0) swprintf(buf + n, size - n, L", waited %d ms", waitedMs);
+}
+
+// ---------- pipe commands ----------
+// \\.\pipe\Directorizer, enabled with pipe=1. One request per line, UTF-8:
+//   PING                 -> OK
+//   LIST                 -> OK <n>, then n lines of slot names in list order
+//   SELECT <name>        -> OK | ERR not found
+//   STAGE <name>         -> OK | ERR not found      (pre-stage it for a rename restore, even with prestage=0)
+//   RESTORE [<name>]     -> OK | ERR failed | ERR superseded   (waits for the restore)
+//   STATUS               -> OK slots=<n> selected=<name> last=<ok|failed|none> last_ms=<t> folder=<path>
+// Commands are forwarded to the UI thread, so they see and change exactly what the
+// dialog shows; restores share the dialog's I/O queue.
+constexpr wchar_t kPipeName[] = L"\\\\.\\pipe\\Directorizer";
+
+struct PipeCommand {
     std::string line;
-    std::wstring folder, file;
-    bool pin = false;
+    std::string reply;
+    uint64_t restoreSeq = 0; // set when the reply must wait for this restore
+    HANDLE done = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    ~PipeCommand() { CloseHandle(done); }
+};
+
+static std::unique_ptr<PipeServer> g_pipe;
 
-    while (std::getline(in, line)) {
-        if (line.rfind("directory=", 0) == 0) folder = FromUtf8(line.substr(10));
-        else if (line.rfind("file=", 0) == 0)   file   = FromUtf8(line.substr(5));
-        else if (line.rfind("pin=", 0) == 0)    pin    = (line.size() > 4 && line[4] == '1');
+// UI thread.
+static void OnPipeCommand(HWND hDlg, PipeCommand& cmd) {
+    size_t sp = cmd.line.find(' ');
+    std::string verb = Lower(cmd.line.substr(0, sp));
+    std::wstring arg = sp == std::string::npos ? std::wstring() : FromUtf8(cmd.line.substr(sp + 1));
+    int idx = FindSlotIndex(arg);
+
+    if (verb == "ping") {
+        cmd.reply = "OK";
+    } else if (verb == "list") {
+        cmd.reply = "OK " + std::to_string(g_list.files.size());
+        for (const auto& f : g_list.files) cmd.reply += "\n" + ToUtf8(f.name);
+    } else if (verb == "select" || verb == "stage") {
+        if (idx < 0) { cmd.reply = "ERR not found"; return; }
+        if (verb == "select") SelectIndex(hDlg, idx);
+        else                  StageSlot(idx, true);
+        cmd.reply = "OK";
+    } else if (verb == "restore") {
+        if (!arg.empty() && idx < 0) { cmd.reply = "ERR not found"; return; }
+        if (idx >= 0) SelectIndex(hDlg, idx);
+        cmd.restoreSeq = RestoreSelected(hDlg);
+    } else if (verb == "status") {
+        int sel = SelectedIndex(hDlg);
+        cmd.reply = "OK slots=" + std::to_string(g_list.files.size()) +
+                    " selected=" + (sel >= 0 ? ToUtf8(g_list.files[sel].name) : std::string()) +
+                    " last=" + g_restores.LastResult() +
+                    " last_ms=" + std::to_string(g_latency.Summarize(kSeriesTotal).last / 1000.0) +
+                    " folder=" + ToUtf8(g_list.folder);
+    } else {
+        cmd.reply = "ERR unknown command";
     }
-    in.close();
+}
 
-    if (!folder.empty()) {
-        SetText(hDlg, IDC_EDIT_DIR, folder);
-        PopulateFileDropdown(GetDlgItem(hDlg, IDC_COMBO_FILES), folder);
+// Pipe thread: hands the line to the dialog and waits for its answer.
+static std::string HandlePipeLine(HWND hDlg, const std::string& line, HANDLE stop) {
+    auto cmd = std::make_shared<PipeCommand>();
+    cmd->line = line;
+    auto* msg = new std::shared_ptr<PipeCommand>(cmd);
+    if (!PostMessageW(hDlg, WM_APP_PIPE_COMMAND, 0, (LPARAM)msg)) {
+        delete msg;
+        return "ERR unavailable";
     }
-    if (!file.empty()) {
-        HWND hCombo = GetDlgItem(hDlg, IDC_COMBO_FILES);
-        SendMessageW(hCombo, CB_SELECTSTRING, (WPARAM)-1, (LPARAM)file.c_str());
+    HANDLE waits[2] = { stop, cmd->done };
+    if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) return "ERR shutting down";
+    if (!cmd->restoreSeq) return cmd->reply;
+
+    switch (g_restores.Wait(cmd->restoreSeq)) {
+    case RestoreTracker::kOk:         return "OK";
+    case RestoreTracker::kFailed:     return "ERR failed";
+    case RestoreTracker::kSuperseded: return "ERR superseded";
+    default:                          return "ERR shutting down";
     }
-    ApplyPin(hDlg, pin);
-    return true;
+}
+
+// ---------- config reload ----------
+// A watcher on the exe folder picks up edits to config.txt. Our own saves leave the
+// stamp ConfigStore recorded, so only someone else's write causes a reload; it
+// replaces any change of ours not yet flushed.
+static std::unique_ptr<DirWatcher> g_configWatcher;
+
+static void WatchConfig(HWND hDlg) {
+    g_configWatcher = std::make_unique<DirWatcher>(GetExeDir().native(), [hDlg](std::vector<DirChange>&& changes, bool overflow) {
+        bool hit = overflow;
+        for (const auto& c : changes) {
+            hit |= CompareStringOrdinal(c.name.c_str(), -1, L"config.txt", -1, TRUE) == CSTR_EQUAL;
+        }
+        if (hit) PostMessageW(hDlg, WM_APP_CONFIG_CHANGED, 0, 0);
+    });
+}
+
+static void ApplyPipe(HWND hDlg) {
+    if (!g_settings.pipe) {
+        g_pipe.reset();
+    } else if (!g_pipe) {
+        g_pipe = std::make_unique<PipeServer>(kPipeName, [hDlg](const std::string& line, HANDLE stop) {
+            return HandlePipeLine(hDlg, line, stop);
+        });
+    }
+}
+
+// Profiles are matched by name, so the one on screen stays up unless its section
+// went away or its folder or pattern changed.
+static void ReloadConfig(HWND hDlg) {
+    static int retries = 0; // of a file that could not be read yet
+    const Profile before = g_profiles[g_activeProfile];
+    const std::wstring listedName = ListedProfile().name;
+
+    ConfigFile cfg;
+    std::error_code ec;
+    if (!ReadConfig(cfg, ec, retries >= kConfigReloadRetries)) {
+        // Nothing changed here, so ChangedOnDisk() still holds; a locked or truncated
+        // file is tried again shortly, and any later write event retries as well. An
+        // empty file still empty on the last try was emptied on purpose and is taken.
+        if (ec && ++retries <= kConfigReloadRetries) SetTimer(hDlg, kConfigReloadTimer, kConfigReloadMs, nullptr);
+        else retries = 0;
+        return;
+    }
+    retries = 0;
+    UnregisterHotkeys(hDlg);
+    KillTimer(hDlg, kConfigTimer);
+    g_configSavePending = false;
+    const int active = FindProfile(before.name), listed = FindProfile(listedName);
+    g_activeProfile = active >= 0 ? (size_t)active : (size_t)std::max(FindProfile(cfg.profile), 0);
+    g_list.profile = listed >= 0 ? (size_t)listed : g_activeProfile;
+    g_pendingHotkey = 0;
+
+    ApplySettings();
+    ApplyPipe(hDlg);
+    FillProfiles(hDlg);
+    RegisterHotkeys(hDlg);
+    SetListView(hDlg, cfg.listView);
+    ApplyPin(hDlg, cfg.pin);
+
+    const Profile& now = g_profiles[g_activeProfile];
+    if (active < 0 || listed < 0 || now.pattern != before.pattern || now.folder != before.folder) {
+        SetText(hDlg, IDC_EDIT_DIR, now.folder);
+        g_pendingFile = now.file;
+        ScanNow(hDlg);
+    }
+    SetText(hDlg, IDC_STATUS, L"Config reloaded");
+    SetTimer(hDlg, kStatusTimer, 2500, nullptr);
 }
 
 // ---------- dialog proc ----------
 static INT_PTR CALLBACK DlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
     case WM_INITDIALOG: {
-        INITCOMMONCONTROLSEX icc{ sizeof(icc), ICC_STANDARD_CLASSES };
-        InitCommonControlsEx(&icc);
+        HWND hList = GetDlgItem(hDlg, IDC_LIST_FILES);
+        SendMessageW(hList, LVM_SETEXTENDEDLISTVIEWSTYLE, 0, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+        LVCOLUMNW col{};
+        col.mask = LVCF_WIDTH;
+        SendMessageW(hList, LVM_INSERTCOLUMNW, 0, (LPARAM)&col);
+        SendMessageW(hList, LVM_SETCOLUMNWIDTH, 0, LVSCW_AUTOSIZE_USEHEADER);
 
         wchar_t buf[MAX_PATH]{};
         GetCurrentDirectoryW(MAX_PATH, buf);
         SetText(hDlg, IDC_EDIT_DIR, buf);
         SetText(hDlg, IDC_STATUS, L"");
-        PopulateFileDropdown(GetDlgItem(hDlg, IDC_COMBO_FILES), buf);
+        SendDlgItemMessageW(hDlg, IDC_EDIT_FILTER, EM_SETCUEBANNER, FALSE, (LPARAM)L"Filter");
+
+        g_scanWorker = std::make_unique<JobWorker>();
+        g_ioWorker = std::make_unique<JobWorker>();
+        g_stageWorker = std::make_unique<JobWorker>();
+        g_indexWorker = std::make_unique<JobWorker>();
+        g_prefetchWorker = std::make_unique<JobWorker>();
+        g_prefetchWorker->Submit([] { SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN); });
+
+        // LoadConfig scans the saved folder itself; the working directory only
+        // gets scanned when there is no config to override it.
+        if (!LoadConfig(hDlg)) ScanNow(hDlg);
+        FillProfiles(hDlg);
+        RegisterHotkeys(hDlg);
+        ApplyPipe(hDlg);
+        WatchConfig(hDlg);
+        return TRUE;
+    }
+
+    case WM_APP_PIPE_COMMAND: {
+        std::unique_ptr<std::shared_ptr<PipeCommand>> cmd((std::shared_ptr<PipeCommand>*)lParam);
+        OnPipeCommand(hDlg, **cmd);
+        SetEvent((*cmd)->done);
+        return TRUE;
+    }
+
+    case WM_HOTKEY:
+        OnHotkey(hDlg, (int)wParam);
+        return TRUE;
 
-        LoadConfig(hDlg); // applies saved dir/file and pin state if present
+    case WM_APP_RESTORE_DONE: {
+        wchar_t text[96];
+        if (wParam == 1) SuccessText(text, 96, (int)lParam);
+        if (wParam == 3) swprintf(text, 96, L"Target in use (gave up after %d ms)", (int)lParam);
+        SetDlgItemTextW(hDlg, IDC_STATUS, wParam == 1 || wParam == 3 ? text : wParam == 2 ? L"Verify failed" : L"Failed");
+        SetTimer(hDlg, kStatusTimer, 2500, nullptr);
+        int restored = g_lastRestored ? FileToRow(FindSlotIndex(g_lastRestored->name)) : -1;
+        if (restored >= 0) StageSlot(RowToFile(restored + 1));
+        return TRUE;
+    }
+
+    case WM_APP_FILTER_READY: {
+        std::unique_ptr<FilterBuild> build((FilterBuild*)lParam);
+        if (build->version != g_list.filterVersion) return TRUE; // files changed again since
+        g_list.filter = std::move(build->filter);
+        g_list.filterStale = false;
+        return TRUE;
+    }
+
+    case WM_APP_CONFIG_CHANGED:
+        SetTimer(hDlg, kConfigReloadTimer, kConfigReloadMs, nullptr); // editors write in bursts
+        return TRUE;
+
+    case WM_APP_UNDO_DONE:
+        SetText(hDlg, IDC_STATUS, wParam == 1 ? L"Restore undone" : wParam == 2 ? L"No backup to undo" : L"Undo failed");
+        SetTimer(hDlg, kStatusTimer, 2500, nullptr);
+        return TRUE;
+
+    case WM_APP_SCAN_DONE: {
+        std::unique_ptr<ScanResult> result((ScanResult*)lParam);
+        if (result->generation != g_scanGeneration.load()) return TRUE; // path changed since
+
+        std::wstring select = std::move(g_pendingFile);
+        if (select.empty() && result->folder == g_list.folder && result->profile == g_list.profile &&
+            SelectedIndex(hDlg) >= 0) {
+            select = g_list.files[SelectedIndex(hDlg)].name; // rescan of the same folder keeps its pick
+        }
+
+        g_list.generation = result->generation;
+        g_list.profile = result->profile;
+        g_list.folder = std::move(result->folder);
+        g_list.files  = std::move(result->files);
+        g_list.filter = std::move(result->filter);
+        g_list.filterStale = false;
+        ++g_list.filterVersion; // drops any rebuild of the previous listing
+        RefilterView();
+        g_list.provisional = result->provisional;
+        ShowSlots(hDlg, select);
+
+        ApplyDirChanges(hDlg, g_pendingChanges); // replaying is harmless if the scan saw them
+        if (!g_list.provisional) g_pendingChanges.clear(); // else kept for the real scan
+        RequestFullIndex(hDlg);
+        if (g_pendingHotkey && !g_list.provisional) {
+            const int id = std::exchange(g_pendingHotkey, 0);
+            RunHotkey(hDlg, id);
+        }
+        return TRUE;
+    }
+
+    case WM_APP_DIR_CHANGED: {
+        std::unique_ptr<DirChangeBatch> batch((DirChangeBatch*)lParam);
+        if (batch->generation != g_scanGeneration.load()) return TRUE; // watcher for an old path
+
+        if (batch->overflow) {
+            ScanNow(hDlg); // events were dropped; start over
+        } else if (g_list.generation != batch->generation) {
+            g_pendingChanges.insert(g_pendingChanges.end(), batch->changes.begin(), batch->changes.end());
+        } else {
+            ApplyDirChanges(hDlg, batch->changes);
+            if (g_list.provisional) { // the rescan may have listed the folder before these
+                g_pendingChanges.insert(g_pendingChanges.end(), batch->changes.begin(), batch->changes.end());
+            }
+            std::vector<std::wstring> names;
+            for (const auto& c : batch->changes) {
+                if (IsSlotName(c.name, ListedProfile().pattern) &&
+                    std::find(names.begin(), names.end(), c.name) == names.end()) {
+                    names.push_back(c.name);
+                }
+            }
+            if (!names.empty()) RequestIndex(hDlg, g_list.folder, std::move(names), false);
+        }
+        return TRUE;
+    }
+
+    case WM_APP_DIFF_DONE: {
+        std::unique_ptr<DiffResult> result((DiffResult*)lParam);
+        OnDiffDone(hDlg, *result);
+        return TRUE;
+    }
+
+    case WM_APP_CAPTURE_DONE: {
+        std::unique_ptr<CaptureResult> result((CaptureResult*)lParam);
+        OnCaptureDone(hDlg, *result);
+        return TRUE;
+    }
+
+    case WM_APP_INDEX_DONE: {
+        std::unique_ptr<IndexResult> result((IndexResult*)lParam);
+        if (result->generation == g_list.generation) ApplyIndex(hDlg, *result);
         return TRUE;
     }
 
@@ -206,10 +1918,23 @@ static INT_PTR CALLBACK DlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lPara
         break;
     }
 
+    case WM_NOTIFY: {
+        auto* hdr = (const NMHDR*)lParam;
+        if (hdr->idFrom == IDC_LIST_FILES && OnListNotify(hDlg, hdr)) return TRUE;
+        break;
+    }
+
     case WM_TIMER: {
-        if (wParam == 1) {
-            KillTimer(hDlg, 1);
+        if (wParam == kStatusTimer) {
+            KillTimer(hDlg, kStatusTimer);
             SetText(hDlg, IDC_STATUS, L""); // hide after delay
+        } else if (wParam == kScanTimer) {
+            ScanNow(hDlg); // typing settled
+        } else if (wParam == kConfigTimer) {
+            FlushConfig(hDlg);
+        } else if (wParam == kConfigReloadTimer) {
+            KillTimer(hDlg, kConfigReloadTimer);
+            if (g_config.ChangedOnDisk()) ReloadConfig(hDlg);
         }
         return TRUE;
     }
@@ -222,50 +1947,65 @@ static INT_PTR CALLBACK DlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lPara
             std::wstring chosen;
             if (PickFolder(chosen)) {
                 SetText(hDlg, IDC_EDIT_DIR, chosen);
-                PopulateFileDropdown(GetDlgItem(hDlg, IDC_COMBO_FILES), chosen);
+                ScanNow(hDlg);
             }
             return TRUE;
         }
 
+        if (id == IDC_EDIT_FILTER && code == EN_CHANGE) {
+            OnFilterChanged(hDlg);
+            return TRUE;
+        }
         if (id == IDC_EDIT_DIR && code == EN_CHANGE) {
-            std::wstring folder = GetText(hDlg, IDC_EDIT_DIR);
-            PopulateFileDropdown(GetDlgItem(hDlg, IDC_COMBO_FILES), folder);
+            ++g_scanGeneration; // abandon any scan of the previous path
+            SetTimer(hDlg, kScanTimer, kScanDebounceMs, nullptr);
             return TRUE;
         }
 
         if (id == IDC_PIN && code == BN_CLICKED) {
             BOOL checked = (SendMessageW(GetDlgItem(hDlg, IDC_PIN), BM_GETCHECK, 0, 0) == BST_CHECKED);
             ApplyPin(hDlg, checked);
+            SaveConfig(hDlg);
             return TRUE;
         }
 
-        if (id == IDOK) { // Overwrite
-            std::wstring folder = GetText(hDlg, IDC_EDIT_DIR);
-            HWND hCombo = GetDlgItem(hDlg, IDC_COMBO_FILES);
-            int idx = (int)SendMessageW(hCombo, CB_GETCURSEL, 0, 0);
-
-            std::wstring selectedFile;
-            if (idx >= 0) {
-                wchar_t name[1024]{};
-                SendMessageW(hCombo, CB_GETLBTEXT, idx, (LPARAM)name);
-                selectedFile = name;
-            }
+        if (id == IDC_COMBO_PROFILE && code == CBN_SELCHANGE) {
+            LRESULT sel = SendDlgItemMessageW(hDlg, IDC_COMBO_PROFILE, CB_GETCURSEL, 0, 0);
+            if (sel >= 0) SwitchProfile(hDlg, (size_t)sel);
+            return TRUE;
+        }
 
-            fs::path src  = fs::path(folder) / selectedFile;       // from dropdown
-            fs::path dest = fs::path(folder) / L"bf2savefile.sav"; // fixed target
+        if (id == IDC_COMBO_FILES && code == CBN_SELCHANGE) {
+            OnSelectionChanged(hDlg);
+            return TRUE;
+        }
 
-            std::error_code ec;
-            if (!selectedFile.empty() && fs::exists(src, ec)) {
-                fs::copy_file(src, dest, fs::copy_options::overwrite_existing, ec);
-            } else {
-                ec = std::make_error_code(std::errc::no_such_file_or_directory);
-            }
+        if (id == IDC_BUTTON_COMPARE) {
+            CompareSelected(hDlg);
+            return TRUE;
+        }
 
-            BOOL pinChecked = (SendMessageW(GetDlgItem(hDlg, IDC_PIN), BM_GETCHECK, 0, 0) == BST_CHECKED);
-            SaveConfig(folder, selectedFile, pinChecked != 0);
+        if (id == IDC_BUTTON_CAPTURE) {
+            CaptureTarget(hDlg);
+            return TRUE;
+        }
+
+        if (id == IDC_BUTTON_STATS) {
+            std::ofstream csv(GetExeDir() / L"latency.csv", std::ios::binary);
+            bool saved = csv && g_latency.WriteCsv(csv);
+            SetText(hDlg, IDC_STATUS, saved ? L"Saved latency.csv" : L"Failed");
+            SetTimer(hDlg, kStatusTimer, 2500, nullptr);
+            return TRUE;
+        }
 
-            SetText(hDlg, IDC_STATUS, ec ? L"Failed" : L"Success!");
-            SetTimer(hDlg, 1, 2500, nullptr);
+        if (id == IDC_LISTMODE && code == BN_CLICKED) {
+            SetListView(hDlg, SendMessageW(GetDlgItem(hDlg, IDC_LISTMODE), BM_GETCHECK, 0, 0) == BST_CHECKED);
+            SaveConfig(hDlg);
+            return TRUE;
+        }
+
+        if (id == IDOK) { // Overwrite
+            RestoreSelected(hDlg);
             return TRUE;
         }
         break;
@@ -274,14 +2014,232 @@ static INT_PTR CALLBACK DlgProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lPara
     case WM_CLOSE:
         EndDialog(hDlg, 0);
         return TRUE;
+
+    case WM_DESTROY:
+        UnregisterHotkeys(hDlg);
+        g_configWatcher.reset();
+        FlushConfig(hDlg);
+        g_restores.Shutdown(); // releases a pipe client waiting on a restore
+        g_pipe.reset();
+        ++g_scanGeneration;  // let an in-flight scan bail out before the join
+        g_watcher.reset();
+        g_scanWorker.reset();
+        g_ioWorker.reset(); // waits for a restore that is mid-write
+        g_stageWorker.reset();
+        g_indexWorker.reset();
+        ++g_prefetchGeneration; // stops a read in flight
+        g_prefetchWorker.reset();
+        g_staged.Discard();
+        return TRUE;
     }
     return FALSE;
 }
 
+// ---------- command line (headless) ----------
+//   Directorizer.exe [--profile P] [--dir D] (--restore NAME | --list) [--mode copy|copyex|delta|atomic] [--verify] [--quiet]
+//   Directorizer.exe [--profile P] [--dir D] --pack OUT.dzpack [--compress]
+//   Directorizer.exe [--profile P] [--dir D] --undo
+//   Directorizer.exe [--profile P] [--dir D] --diff A B [--csv OUT.csv]
+// Runs the same restore as Overwrite without creating a window or initializing COM.
+// --profile, --dir and --mode default to config.txt. Exit code: 0 ok, 1 restore
+// failed, 2 usage.
+struct CliOptions {
+    bool any = false; // any recognised flag: stay headless
+    bool list = false;
+    bool quiet = false;
+    bool verify = false;
+    bool compress = false;
+    bool undo = false;
+    bool haveMode = false;
+    RestoreMode mode = RestoreMode::Copy;
+    std::wstring profile, dir, restore, pack;
+    std::wstring diffA, diffB, csv;
+};
+
+static bool ParseCommandLine(CliOptions& opt, std::wstring& error) {
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv) return true;
+
+    for (int i = 1; i < argc && error.empty(); ++i) {
+        std::wstring arg = argv[i];
+        auto value = [&](std::wstring& out) {
+            if (i + 1 < argc) out = argv[++i];
+            else error = L"missing value for " + arg;
+        };
+        opt.any = true;
+        if (arg == L"--dir")          value(opt.dir);
+        else if (arg == L"--profile") value(opt.profile);
+        else if (arg == L"--restore") value(opt.restore);
+        else if (arg == L"--list")    opt.list = true;
+        else if (arg == L"--quiet")   opt.quiet = true;
+        else if (arg == L"--verify")  opt.verify = true;
+        else if (arg == L"--pack")    value(opt.pack);
+        else if (arg == L"--compress") opt.compress = true;
+        else if (arg == L"--undo")    opt.undo = true;
+        else if (arg == L"--diff")    { value(opt.diffA); value(opt.diffB); }
+        else if (arg == L"--csv")     value(opt.csv);
+        else if (arg == L"--mode") {
+            std::wstring m;
+            value(m);
+            opt.haveMode = true;
+            opt.mode = ParseRestoreMode(ToUtf8(m));
+            if (error.empty() && RestoreModeName(opt.mode) != ToUtf8(m)) error = L"unknown mode " + m;
+        } else {
+            error = L"unknown option " + arg;
+        }
+    }
+    LocalFree(argv);
+    if (error.empty() && opt.any && opt.restore.empty() && !opt.list && opt.pack.empty() && !opt.undo &&
+        opt.diffA.empty()) {
+        error = L"nothing to do: use --restore, --list, --pack, --undo or --diff";
+    }
+    return error.empty();
+}
+
+// A GUI-subsystem exe has no console of its own: write to redirected handles as UTF-8,
+// else to the console of whoever started us.
+static void CliPrint(const CliOptions& opt, const std::wstring& line) {
+    if (opt.quiet) return;
+    static HANDLE out = [] {
+        HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
+        if ((!h || h == INVALID_HANDLE_VALUE) && AttachConsole(ATTACH_PARENT_PROCESS)) {
+            h = CreateFileW(L"CONOUT$", GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+        }
+        return h;
+    }();
+    if (!out || out == INVALID_HANDLE_VALUE) return;
+
+    std::wstring text = line + L"\r\n";
+    DWORD mode = 0, written = 0;
+    if (GetConsoleMode(out, &mode)) {
+        WriteConsoleW(out, text.c_str(), (DWORD)text.size(), &written, nullptr);
+    } else {
+        std::string utf8 = ToUtf8(text);
+        WriteFile(out, utf8.data(), (DWORD)utf8.size(), &written, nullptr);
+    }
+}
+
+static int RunHeadless(const CliOptions& opt) {
+    ConfigFile cfg;
+    std::error_code configEc;
+    ReadConfig(cfg, configEc);
+    g_backups.SetDepth(g_settings.backups);
+    SetIoOptions(g_settings.io);
+    const int found = FindProfile(!opt.profile.empty() ? opt.profile : cfg.profile);
+    if (found < 0 && !opt.profile.empty()) {
+        CliPrint(opt, L"unknown profile " + opt.profile);
+        return 2;
+    }
+    const Profile& profile = g_profiles[(size_t)std::max(found, 0)];
+    std::wstring folder = !opt.dir.empty() ? opt.dir : profile.folder;
+    if (folder.empty()) {
+        wchar_t buf[MAX_PATH]{};
+        GetCurrentDirectoryW(MAX_PATH, buf);
+        folder = buf;
+    }
+
+    if (!opt.pack.empty()) {
+        std::error_code ec;
+        size_t count = 0;
+        if (!WritePack(folder, opt.pack, opt.compress, count, ec, profile.pattern)) {
+            CliPrint(opt, L"Failed: " + FromUtf8(ec.message()));
+            return 1;
+        }
+        CliPrint(opt, L"Packed " + std::to_wstring(count) + L" slots into " + opt.pack);
+        return 0;
+    }
+
+    if (opt.undo) {
+        std::error_code ec;
+        if (!g_backups.Undo(TargetPath(folder, profile), ec)) {
+            CliPrint(opt, ec ? L"Failed: " + FromUtf8(ec.message()) : L"Failed: no backup to undo");
+            return 1;
+        }
+        CliPrint(opt, L"Restore undone");
+        return 0;
+    }
+
+    if (!opt.diffA.empty()) {
+        std::error_code ec;
+        SlotDiff d;
+        if (!DiffSlots(fs::path(folder) / opt.diffA, fs::path(folder) / opt.diffB, kDiffMergeGap, d, ec)) {
+            CliPrint(opt, L"Failed: " + FromUtf8(ec.message()));
+            return 1;
+        }
+        if (!opt.csv.empty()) {
+            std::ofstream csv(fs::path(opt.csv), std::ios::binary);
+            if (!csv || !d.WriteCsv(csv)) {
+                CliPrint(opt, L"Failed: cannot write " + opt.csv);
+                return 1;
+            }
+        } else {
+            wchar_t line[96];
+            for (size_t i = 0; i < d.ranges.size(); ++i) {
+                swprintf(line, 96, L"0x%08llx +%llu  ", (unsigned long long)d.ranges[i].offset,
+                         (unsigned long long)d.ranges[i].length);
+                CliPrint(opt, line + FromUtf8(d.hexA[i]) + L"  |  " + FromUtf8(d.hexB[i]));
+            }
+        }
+        CliPrint(opt, std::to_wstring(d.ranges.size()) + L" ranges, " + std::to_wstring(d.Differing()) + L" bytes differ");
+        return 0;
+    }
+
+    if (opt.list) {
+        std::vector<SlotEntry> files;
+        EnumerateSlotFiles(folder, files, [] { return false; }, profile.pattern);
+        for (const auto& f : files) CliPrint(opt, f.name);
+        if (opt.restore.empty()) return 0;
+    }
+
+    std::error_code ec;
+    bool matched = true;
+    if (IsSlotName(opt.restore, profile.pattern)) {
+        const fs::path src = fs::path(folder) / opt.restore, dest = TargetPath(folder, profile);
+        const RestoreMode mode = opt.haveMode ? opt.mode : g_settings.restoreMode;
+        RestoreTiming timing;
+        const int64_t start = QpcNow();
+        RestoreSlot(src, dest, mode, ec, &timing);
+        timing.ticks[kSeriesTotal] = QpcNow() - start;
+        if (TraceEnabled()) TraceRestore(src, dest, RestoreModeName(mode), timing, ec);
+        if (!ec && (opt.verify || g_settings.verify)) VerifyRestore(src, dest, matched, ec);
+    } else {
+        ec = std::make_error_code(std::errc::invalid_argument);
+    }
+    if (ec) {
+        CliPrint(opt, L"Failed: " + FromUtf8(ec.message()));
+        return 1;
+    }
+    if (!matched) {
+        CliPrint(opt, L"Failed: target does not match the slot after writing");
+        return 1;
+    }
+    CliPrint(opt, L"Success!");
+    return 0;
+}
+
 // ---------- entry ----------
 int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE, LPWSTR, int) {
+    CliOptions cli;
+    std::wstring cliError;
+    if (!ParseCommandLine(cli, cliError)) {
+        CliPrint(cli, cliError);
+        return 2;
+    }
+    TraceLoggingRegister(g_trace);
+    if (cli.any) {
+        int rc = RunHeadless(cli);
+        TraceLoggingUnregister(g_trace);
+        return rc;
+    }
+
+    // before the dialog exists: its template holds a SysListView32
+    INITCOMMONCONTROLSEX icc{ sizeof(icc), ICC_STANDARD_CLASSES | ICC_LISTVIEW_CLASSES };
+    InitCommonControlsEx(&icc);
+
     CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
     DialogBoxParamW(hInstance, MAKEINTRESOURCEW(IDD_MAIN), nullptr, DlgProc, 0);
     CoUninitialize();
+    TraceLoggingUnregister(g_trace);
     return 0;
 }
@@ -7,3 +7,10 @@
 #define IDC_COMBO_FILES     1003
 #define IDC_STATUS          1004
 #define IDC_PIN             1005
+#define IDC_LIST_FILES      1006
+#define IDC_LISTMODE        1007
+#define IDC_BUTTON_STATS    1008
+#define IDC_BUTTON_CAPTURE  1009
+#define IDC_EDIT_FILTER     1010
+#define IDC_COMBO_PROFILE   1011
+#define IDC_BUTTON_COMPARE  1012